@@ -1,13 +1,32 @@
 #ifndef BINHEX4_HPP
 #define BINHEX4_HPP
 
+#include <array>
+#include <atomic>
 #include <iostream>
+#include <thread>
 
 #include "file.hpp"
 
 namespace BinHex4{
 
+	struct Result;
+
+	// 結果を戻り値で返すので、複数のスレッドから同時に呼んでよい
+	Result parse(const std::string & path, const bool verify = true);
+	Result parse(std::span<const u8> raw, const bool verify = true);
+	std::vector<Result> parseFiles(const std::vector<std::string> & paths, const u32 threads = std::max(1u, std::thread::hardware_concurrency()), const bool verify = true);
+
+	// FileName, Version, Type, Creator, Flags, data, resource を BinHex4.0 にする
+	std::vector<u8> encode(const Result & file);
+	void write(const std::string & path, const Result & file);
+
+	class Encoder;
+	class Decoder;
+
+	// 結果を last_* に置く 同時には呼べない
 	std::vector<u8> read(const std::string & path);
+	std::vector<u8> read(std::span<const u8> raw);
 
 	std::string last_FileName;
 	u8 last_Version;
@@ -19,6 +38,9 @@ namespace BinHex4{
 	enum class Err;
 	enum Err last_error;
 
+	// false にすると CRC の照合を省く
+	bool check_crc = true;
+
 	enum class Err{
 		NONE, // 正常に処理されたはずです
 		INCORRECT_COMMENT, // 最初のコメント行が間違っています
@@ -28,10 +50,24 @@ namespace BinHex4{
 		CRC_ERROR // データの欠損があるかもしれません
 	};
 
+	enum class Fork{ DATA, RESOURCE };
+
+	// error が NONE, CRC_ERROR 以外のときは途中までしか埋まっていません
+	struct Result{
+		std::string FileName;
+		u8 Version = 0;
+		std::string Type;
+		std::string Creator;
+		u16 Flags = 0;
+		std::vector<u8> data;
+		std::vector<u8> resource;
+		enum Err error = Err::NONE;
+	};
+
 	namespace detail{
 		#define XX 0xFF
 		/* !"#$%&'()*+,-012345689@ABCDEFGHIJKLMNPQRSTUVXYZ[`abcdefhijklmpqr */
-		const u8 table[] = {
+		constexpr u8 table[] = {
 			  XX,0x00,0x01,0x02, 0x03,0x04,0x05,0x06, 0x07,0x08,0x09,0x0A, 0x0B,0x0C,  XX,  XX,
 			0x0D,0x0E,0x0F,0x10, 0x11,0x12,0x13,  XX, 0x14,0x15,  XX,  XX,   XX,  XX,  XX,  XX,
 			0x16,0x17,0x18,0x19, 0x1A,0x1B,0x1C,0x1D, 0x1E,0x1F,0x20,0x21, 0x22,0x23,0x24,  XX,
@@ -41,13 +77,62 @@ namespace BinHex4{
 		};
 		#undef XX
 
+		constexpr char alphabet[] = "!\"#$%&'()*+,-012345689@ABCDEFGHIJKLMNPQRSTUVXYZ[`abcdefhijklmpqr";
+
+		// 全ての文字に対する表 0x00~0x3F: 6bitの値 SKIP: 読み飛ばす XX: テーブル外
+		constexpr u8 SKIP = 0xFE;
+		constexpr std::array<u8, 256> decode_table = []{
+			std::array<u8, 256> res{};
+			for(u32 c = 0; c < 256; ++c){
+				const u8 ch = c - 0x20;
+				res[c] = ch >= 0x60 ? SKIP : table[ch];
+			}
+			return res;
+		}();
+
+		// CRC-16/XMODEM (多項式 0x1021, 初期値 0) を8バイトずつ処理する表
+		// crc_table[k][b]: バイト b の後に 0 が k バイト続いたときの CRC
+		constexpr std::array<std::array<u16, 256>, 8> crc_table = []{
+			std::array<std::array<u16, 256>, 8> res{};
+			for(u32 b = 0; b < 256; ++b){
+				u16 crc = b << 8;
+				for(u32 i = 0; i < 8; ++i) crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+				res[0][b] = crc;
+			}
+			for(u32 k = 1; k < 8; ++k){
+				for(u32 b = 0; b < 256; ++b){
+					const u16 prev = res[k - 1][b];
+					res[k][b] = (prev << 8) ^ res[0][prev >> 8];
+				}
+			}
+			return res;
+		}();
+
+		// src から n バイトの CRC を計算する dst を渡せば同時にそこへ写す
+		u16 crc16(const u8* src, size_t n, u16 crc, u8* dst = nullptr){
+			const auto & t = crc_table;
+			for(; n >= 8; n -= 8, src += 8){
+				u8 b[8];
+				std::memcpy(b, src, 8);
+				if(dst){
+					std::memcpy(dst, b, 8);
+					dst += 8;
+				}
+				crc = t[7][b[0] ^ (crc >> 8)] ^ t[6][b[1] ^ (crc & 0xFF)] ^ t[5][b[2]] ^ t[4][b[3]]
+					^ t[3][b[4]] ^ t[2][b[5]] ^ t[1][b[6]] ^ t[0][b[7]];
+			}
+			for(; n; --n){
+				const u8 c = *src++;
+				if(dst) *dst++ = c;
+				crc = (crc << 8) ^ t[0][(crc >> 8) ^ c];
+			}
+			return crc;
+		}
+
 		const std::string correct_comment = "(This file must be converted with BinHex 4.0)";
 		const u8 comment_size = correct_comment.size();
 
-		enum Err trimLR(
-			std::vector<u8>::const_iterator & l,
-			std::vector<u8>::const_iterator & r
-		){
+		enum Err trimLR(const u8* & l, const u8* & r){
 			l = std::find(l, r, '(');
 			if(l + comment_size > r) return Err::UNRECOGNIZABLE;
 			if(!std::equal(l, l + comment_size, correct_comment.data())) return Err::INCORRECT_COMMENT;
@@ -60,86 +145,551 @@ namespace BinHex4{
 			return Err::NONE;
 		}
 
-		enum Err decode(
-			std::vector<u8>::const_iterator & l,
-			std::vector<u8>::const_iterator & r,
-			std::vector<u8> & dst
-		){
-			bool mode90 = false;
-			u8 cnt = 0;
+		// 4文字 -> 3バイト にまとめて変換する
+		// 文字数が4の倍数でなければ、最後に途中までのバイトを1つ付ける (partial = true)
+		enum Err unpack6(const u8* & l, const u8* const r, std::vector<u8> & dst, bool & partial){
+			dst.resize((r - l) / 4 * 3 + 3);
+			u8* out = dst.data();
+			u32 acc = 0, cnt = 0;
 			while(l != r){
-				u8 ch = *l++;
-				ch -= 0x20;
-				if(ch >= 0x60) continue;
-				ch = table[ch];
-				if(ch == 0xFF) return Err::OUT_OF_TABLE;
-				if(cnt > 0){
-					dst.back() |= ch >> (6 - cnt);
-					if(mode90){
-						u8 times = dst.back();
-						dst.pop_back(); // times
-						if(times != 0){
-							times --;
-							dst.pop_back(); // 0x90
-							u8 ch = dst.back();
-							dst.resize(dst.size() + times, ch);
-						}
-						mode90 = false;
-					}
-					else{
-						mode90 = dst.back() == 0x90;
+				// 途中に読み飛ばす文字が無ければ4文字まとめて処理する
+				if(cnt == 0){
+					while(r - l >= 4){
+						const u8 a = decode_table[l[0]], b = decode_table[l[1]], c = decode_table[l[2]], d = decode_table[l[3]];
+						if(((a | b | c | d) & 0xC0) != 0) break;
+						const u32 v = u32(a) << 18 | u32(b) << 12 | u32(c) << 6 | d;
+						out[0] = v >> 16;
+						out[1] = v >> 8;
+						out[2] = v;
+						out += 3;
+						l += 4;
 					}
+					if(l == r) break;
+				}
+				const u8 ch = decode_table[*l++];
+				if(ch == SKIP) continue;
+				if(ch == 0xFF){
+					dst.resize(out - dst.data());
+					partial = false;
+					return Err::OUT_OF_TABLE;
 				}
-				cnt += 2;
-				if(cnt < 8){
-					dst.push_back(ch << cnt);
+				acc = acc << 6 | ch;
+				if(++cnt == 4){
+					out[0] = acc >> 16;
+					out[1] = acc >> 8;
+					out[2] = acc;
+					out += 3;
+					acc = cnt = 0;
 				}
-				cnt &= 0b110;
 			}
+			// 途中までのバイト (上位から詰めたもの)
+			if(cnt > 0){
+				acc <<= 6 * (4 - cnt);
+				for(u32 i = 0; i < cnt; ++i) *out++ = acc >> (16 - 8 * i);
+			}
+			partial = cnt > 0;
+			dst.resize(out - dst.data());
 			return Err::NONE;
 		}
 
-		enum Err extract(const std::vector<u8> & src, std::vector<u8> & dst){
-			auto itr = src.begin(), end = src.end();
-			if(itr + 26 >= end) return Err::FAULTY_DATA;
-			u8 FileName_len = *itr++;
-			if(itr + FileName_len + 25 >= end) return Err::FAULTY_DATA;
-			last_FileName = readString(itr, FileName_len);
-			last_Version = *itr++;
-			last_Type = readString(itr, 4);
-			last_Creator = readString(itr, 4);
-			last_Flags = readBE<u16>(itr);
-			u32 Data_len = readBE<u32>(itr);
-			u32 Rsrc_len = readBE<u32>(itr);
-			u16 crc1 = readBE<u16>(itr);
-			if(itr + Data_len > end) return Err::FAULTY_DATA;
-			dst = readBytes(itr, Data_len);
-			if(itr + 2 > end) return Err::FAULTY_DATA;
-			u16 crc2 = readBE<u16>(itr);
-			if(itr + Rsrc_len > end) return Err::FAULTY_DATA;
-			last_Resource = readBytes(itr, Rsrc_len);
-			if(itr + 2 > end) return Err::FAULTY_DATA;
-			u16 crc3 = readBE<u16>(itr);
+		// 0x90 による連長を展開する
+		// 大きさを数えてから確保し、もう一度なぞって埋める 0x90 の間は memcpy で写す
+		void expand90(const u8* const src, const size_t n, std::vector<u8> & dst){
+			const u8* const end = src + n;
+			size_t size = 0;
+			for(const u8* p = src; p != end;){
+				const u8* q = static_cast<const u8*>(std::memchr(p, 0x90, end - p));
+				if(q == nullptr) q = end;
+				size += q - p;
+				if(q == end) break;
+				if(q + 1 == end){
+					size ++;
+					break;
+				}
+				const u8 times = q[1];
+				if(times == 0) size ++;
+				else if(size > 0) size += times - 1;
+				p = q + 2;
+			}
+			dst.resize(size);
+			u8* out = dst.data();
+			for(const u8* p = src; p != end;){
+				const u8* q = static_cast<const u8*>(std::memchr(p, 0x90, end - p));
+				if(q == nullptr) q = end;
+				std::memcpy(out, p, q - p);
+				out += q - p;
+				if(q == end) break;
+				if(q + 1 == end){
+					*out++ = 0x90;
+					break;
+				}
+				const u8 times = q[1];
+				if(times == 0) *out++ = 0x90;
+				else if(out != dst.data()) out = std::fill_n(out, times - 1, out[-1]);
+				p = q + 2;
+			}
+		}
+
+		enum Err decode(const u8* & l, const u8* & r, std::vector<u8> & dst){
+			std::vector<u8> packed;
+			bool partial;
+			const enum Err e = unpack6(l, r, packed, partial);
+			const size_t complete = packed.size() - (partial ? 1 : 0);
+			expand90(packed.data(), complete, dst);
+			if(partial) dst.push_back(packed.back());
+			return e;
+		}
+
+		// フォークを dst に写しながら CRC を計算し、続く格納値と照合する
+		enum Err read_fork(ByteReader & in, const u32 len, std::vector<u8> & dst, const bool verify, bool & crc_ok){
+			if(!in.need(len)) return Err::FAULTY_DATA;
+			dst.resize(len);
+			const u16 crc = verify ? crc16(in.data(), len, 0, dst.data()) : 0;
+			if(!verify) std::memcpy(dst.data(), in.data(), len);
+			in.skip(len);
+			if(!in.need(2)) return Err::FAULTY_DATA;
+			if(in.getBE<u16>() != crc && verify) crc_ok = false;
 			return Err::NONE;
 		}
+
+		enum Err extract(const std::vector<u8> & src, Result & dst, const bool verify){
+			ByteReader in(src);
+			if(src.size() <= 26) return Err::FAULTY_DATA;
+			u8 FileName_len = in.getBE<u8>();
+			if(in.remaining() < FileName_len + 25u) return Err::FAULTY_DATA;
+			dst.FileName = in.string(FileName_len);
+			dst.Version = in.getBE<u8>();
+			dst.Type = in.string(4);
+			dst.Creator = in.string(4);
+			dst.Flags = in.getBE<u16>();
+			u32 Data_len = in.getBE<u32>();
+			u32 Rsrc_len = in.getBE<u32>();
+			bool crc_ok = true;
+			// ヘッダの CRC はファイル名の長さから Rsrc_len までが対象
+			const u16 crc1 = verify ? crc16(src.data(), in.position(), 0) : 0;
+			if(in.getBE<u16>() != crc1 && verify) crc_ok = false;
+			enum Err err;
+			if((err = read_fork(in, Data_len, dst.data, verify, crc_ok)) != Err::NONE) return err;
+			if((err = read_fork(in, Rsrc_len, dst.resource, verify, crc_ok)) != Err::NONE) return err;
+			return crc_ok ? Err::NONE : Err::CRC_ERROR;
+		}
 	}
 
-	std::vector<u8> read(const std::string & path){
+	// 任意の大きさに区切って中身を流し込める符号化器
+	// フォークの大きさは先に決めておき、put() には data, resource の順に続けて渡す
+	// 出力は呼び出しのたびに out の後ろに足されるので、out を書き出して空にすれば一定のメモリで済む
+	class Encoder{
+	public:
+		Encoder(const Result & info, const u32 data_size, const u32 resource_size){
+			out_head.insert(out_head.end(), detail::correct_comment.begin(), detail::correct_comment.end());
+			out_head.insert(out_head.end(), {'\r', '\n', '\r', '\n', ':'});
+			col = 1;
+
+			const std::string name = info.FileName.substr(0, 63);
+			std::vector<u8> header(name.size() + 20);
+			ByteWriter w(header);
+			w.write(name.size());
+			w.string(name);
+			w.write(info.Version);
+			w.string((info.Type + "    ").substr(0, 4));
+			w.string((info.Creator + "    ").substr(0, 4));
+			w.writeBE<u16>(info.Flags);
+			w.writeBE<u32>(data_size);
+			w.writeBE<u32>(resource_size);
+			feed(header.data(), header.size(), out_head);
+			close_section(out_head);
+
+			left = data_size;
+			rsrc_size = resource_size;
+			close_forks(out_head);
+		}
+
+		// 余分に渡されたバイトは捨てて finish() で FAULTY_DATA を返す
+		void put(const std::span<const u8> src, std::vector<u8> & out){
+			flush_head(out);
+			const u8* p = src.data();
+			size_t n = src.size();
+			while(n > 0 && fork < 2){
+				const size_t k = std::min<size_t>(n, left);
+				feed(p, k, out);
+				p += k;
+				n -= k;
+				left -= k;
+				close_forks(out);
+			}
+			if(n > 0) overflow = true;
+		}
+
+		enum Err finish(std::vector<u8> & out){
+			flush_head(out);
+			flush_run(out);
+			if(packed == 1) emit_group(acc << 16, 2, out);
+			if(packed == 2) emit_group(acc << 8, 3, out);
+			packed = 0;
+			out.insert(out.end(), {':', '\r', '\n'});
+			return fork < 2 || overflow ? Err::FAULTY_DATA : Err::NONE;
+		}
+
+	private:
+		std::vector<u8> out_head;
+		u32 left = 0, rsrc_size = 0;
+		u32 fork = 0;
+		bool overflow = false;
+		u16 crc = 0;
+		u8 run_byte = 0;
+		u32 run_len = 0;
+		u32 acc = 0, packed = 0, col = 0;
+
+		void flush_head(std::vector<u8> & out){
+			if(out_head.empty()) return;
+			out.insert(out.end(), out_head.begin(), out_head.end());
+			out_head.clear();
+		}
+
+		// CRC を進めながら連長圧縮に回す
+		void feed(const u8* p, const size_t n, std::vector<u8> & out){
+			crc = detail::crc16(p, n, crc);
+			const u8* const end = p + n;
+			while(p != end){
+				if(run_len > 0 && *p == run_byte){
+					while(p != end && *p == run_byte && run_len < 255){
+						run_len ++;
+						p ++;
+					}
+					if(p == end || run_len < 255) continue;
+				}
+				flush_run(out);
+				run_byte = *p++;
+				run_len = 1;
+			}
+		}
+
+		void close_section(std::vector<u8> & out){
+			const u8 stored[2] = {u8(crc >> 8), u8(crc)};
+			feed(stored, 2, out);
+			crc = 0;
+		}
+
+		void close_forks(std::vector<u8> & out){
+			while(fork < 2 && left == 0){
+				close_section(out);
+				fork ++;
+				left = fork == 1 ? rsrc_size : 0;
+			}
+		}
+
+		// 0x90 は 0x90 0x00 に、同じバイトの並びは <byte> 0x90 <個数> にする
+		void put_literal(const u8 b, std::vector<u8> & out){
+			pack(b, out);
+			if(b == 0x90) pack(0x00, out);
+		}
+
+		void flush_run(std::vector<u8> & out){
+			if(run_len == 0) return;
+			put_literal(run_byte, out);
+			if(run_len >= (run_byte == 0x90 ? 3u : 4u)){
+				pack(0x90, out);
+				pack(run_len, out);
+			}
+			else for(u32 i = 1; i < run_len; ++i) put_literal(run_byte, out);
+			run_len = 0;
+		}
+
+		void pack(const u8 b, std::vector<u8> & out){
+			acc = acc << 8 | b;
+			if(++packed == 3){
+				emit_group(acc, 4, out);
+				acc = packed = 0;
+			}
+		}
+
+		// 上位から6bitずつ文字にする 64桁で改行
+		void emit_group(const u32 v, const u32 chars, std::vector<u8> & out){
+			for(u32 i = 0; i < chars; ++i){
+				out.push_back(detail::alphabet[(v >> (18 - 6 * i)) & 0x3F]);
+				if(++col == 64){
+					out.push_back('\r');
+					out.push_back('\n');
+					col = 0;
+				}
+			}
+		}
+	};
+
+	// 任意の大きさに区切った BinHex4.0 の文字列を受け取って復号する
+	// フォークの中身は sink に少しずつ渡されるので、全体を持っておく必要はありません
+	class Decoder{
+	public:
+		using Sink = std::function<void(Fork, std::span<const u8>)>;
+
+		Decoder(Sink sink_, const bool verify_ = true) : sink(std::move(sink_)), verify(verify_) {}
+
+		// 致命的な誤りが起きた後の入力は無視する
+		enum Err put(const std::span<const u8> src){
+			if(failed()) return err;
+			if(stage == Stage::COMMENT){
+				pre.insert(pre.end(), src.begin(), src.end());
+				find_start();
+			}
+			else if(stage == Stage::BODY) body(src.data(), src.data() + src.size());
+			return err;
+		}
+
+		enum Err finish(){
+			if(failed()) return err;
+			if(stage == Stage::COMMENT) return err = Err::UNRECOGNIZABLE;
+			if(stage == Stage::BODY) end_body();
+			if(section != Section::TAIL) err = Err::FAULTY_DATA;
+			return err;
+		}
+
+		// ヘッダを読み終えていれば FileName などが埋まっています (data, resource は空)
+		bool has_header() const{ return section > Section::HEADER; }
+		const Result & header() const{ return info; }
+		enum Err error() const{ return err; }
+
+	private:
+		enum class Stage{ COMMENT, BODY, END };
+		enum class Section{ HEADER, DATA, DATA_CRC, RSRC, RSRC_CRC, TAIL };
+
+		const Sink sink;
+		const bool verify;
+		Result info;
+		enum Err err = Err::NONE;
+		Stage stage = Stage::COMMENT;
+		Section section = Section::HEADER;
+		std::vector<u8> pre, head, buf;
+		u32 acc = 0, cnt = 0;
+		bool marker = false, has_last = false;
+		u8 last = 0;
+		u32 left = 0, rsrc_size = 0;
+		u16 crc = 0;
+		u8 stored[2];
+		u32 stored_cnt = 0;
+
+		bool failed() const{ return err != Err::NONE && err != Err::CRC_ERROR; }
+
+		// 最初のコメントとそれに続く ':' を探す
+		void find_start(){
+			using detail::correct_comment, detail::comment_size;
+			auto l = std::find(pre.begin(), pre.end(), '(');
+			if(l == pre.end()){
+				pre.clear();
+				return;
+			}
+			pre.erase(pre.begin(), l);
+			if(pre.size() < comment_size) return;
+			if(!std::equal(pre.begin(), pre.begin() + comment_size, correct_comment.begin())){
+				err = Err::INCORRECT_COMMENT;
+				return;
+			}
+			const auto colon = std::find(pre.begin() + comment_size, pre.end(), ':');
+			if(colon == pre.end()) return;
+			stage = Stage::BODY;
+			std::vector<u8> rest(colon + 1, pre.end());
+			pre = {};
+			body(rest.data(), rest.data() + rest.size());
+		}
+
+		void body(const u8* l, const u8* const r){
+			if(l == r) return;
+			const u8* colon = static_cast<const u8*>(std::memchr(l, ':', r - l));
+			const u8* const e = colon ? colon : r;
+			using detail::decode_table, detail::SKIP;
+			while(l != e && !failed()){
+				if(cnt == 0){
+					while(e - l >= 4){
+						const u8 a = decode_table[l[0]], b = decode_table[l[1]], c = decode_table[l[2]], d = decode_table[l[3]];
+						if(((a | b | c | d) & 0xC0) != 0) break;
+						const u32 v = u32(a) << 18 | u32(b) << 12 | u32(c) << 6 | d;
+						expand(v >> 16);
+						expand(v >> 8);
+						expand(v);
+						l += 4;
+					}
+					if(l == e) break;
+				}
+				const u8 ch = decode_table[*l++];
+				if(ch == SKIP) continue;
+				if(ch == 0xFF){
+					err = Err::OUT_OF_TABLE;
+					break;
+				}
+				acc = acc << 6 | ch;
+				if(++cnt == 4){
+					expand(acc >> 16);
+					expand(acc >> 8);
+					expand(acc);
+					acc = cnt = 0;
+				}
+			}
+			flush();
+			if(colon && !failed()) end_body();
+		}
+
+		// 最後の4文字に満たない分のうち、丸ごと入っているバイトだけを使う
+		void end_body(){
+			acc <<= 6 * (4 - cnt);
+			for(u32 i = 0; i < cnt * 6 / 8; ++i) expand(acc >> (16 - 8 * i));
+			acc = cnt = 0;
+			if(marker) emit(0x90);
+			marker = false;
+			flush();
+			stage = Stage::END;
+		}
+
+		// 0x90 による連長を展開する
+		void expand(const u8 b){
+			if(marker){
+				marker = false;
+				if(b == 0) emit(0x90);
+				else if(has_last){
+					buf.insert(buf.end(), b - 1, last);
+					if(buf.size() >= 1 << 16) flush();
+				}
+			}
+			else if(b == 0x90) marker = true;
+			else emit(b);
+		}
+
+		void emit(const u8 b){
+			buf.push_back(b);
+			last = b;
+			has_last = true;
+			if(buf.size() >= 1 << 16) flush();
+		}
+
+		void flush(){
+			parse(buf.data(), buf.size());
+			buf.clear();
+		}
+
+		void parse(const u8* p, size_t n){
+			while(n > 0){
+				switch(section){
+				case Section::HEADER: {
+					const size_t need = (head.empty() ? 1 : head[0] + 22) - head.size();
+					const size_t k = std::min(n, need);
+					head.insert(head.end(), p, p + k);
+					p += k;
+					n -= k;
+					if(head.size() == head[0] + 22u) read_header();
+					break;
+				}
+				case Section::DATA:
+				case Section::RSRC: {
+					const size_t k = std::min<size_t>(n, left);
+					if(verify) crc = detail::crc16(p, k, crc);
+					if(k > 0) sink(section == Section::DATA ? Fork::DATA : Fork::RESOURCE, std::span<const u8>(p, k));
+					p += k;
+					n -= k;
+					left -= k;
+					if(left == 0) section = Section(int(section) + 1);
+					break;
+				}
+				case Section::DATA_CRC:
+				case Section::RSRC_CRC:
+					stored[stored_cnt++] = *p++;
+					n --;
+					if(stored_cnt == 2){
+						if(verify && (stored[0] << 8 | stored[1]) != crc) err = Err::CRC_ERROR;
+						crc = 0;
+						stored_cnt = 0;
+						left = rsrc_size;
+						section = Section(int(section) + 1);
+						if(section == Section::RSRC && left == 0) section = Section::RSRC_CRC;
+					}
+					break;
+				case Section::TAIL:
+					return;
+				}
+			}
+		}
+
+		void read_header(){
+			ByteReader in(head);
+			const u8 FileName_len = in.getBE<u8>();
+			info.FileName = in.string(FileName_len);
+			info.Version = in.getBE<u8>();
+			info.Type = in.string(4);
+			info.Creator = in.string(4);
+			info.Flags = in.getBE<u16>();
+			left = in.getBE<u32>();
+			rsrc_size = in.getBE<u32>();
+			const u16 calc = verify ? detail::crc16(head.data(), in.position(), 0) : 0;
+			if(in.getBE<u16>() != calc && verify) err = Err::CRC_ERROR;
+			head = {};
+			section = left == 0 ? Section::DATA_CRC : Section::DATA;
+		}
+	};
+
+	std::vector<u8> encode(const Result & file){
+		std::vector<u8> out;
+		// 連長圧縮が効かなければ 4/3 倍に改行の分が加わる
+		out.reserve((file.data.size() + file.resource.size()) / 3 * 4 * 66 / 64 + 256);
+		Encoder enc(file, file.data.size(), file.resource.size());
+		enc.put(file.data, out);
+		enc.put(file.resource, out);
+		enc.finish(out);
+		return out;
+	}
+
+	void write(const std::string & path, const Result & file){
+		writeFile(path, encode(file));
+	}
+
+	Result parse(const std::string & path, const bool verify){
+		const MappedFile raw(path, MappedFile::Access::SEQUENTIAL);
+		return parse(raw.span(), verify);
+	}
+
+	Result parse(std::span<const u8> raw, const bool verify){
 		using namespace detail;
+		Result res;
 
-		const auto raw = readFile(path);
-		auto l = raw.begin(), r = raw.end();
-		if((last_error = trimLR(l, r)) != Err::NONE) return {};
+		const u8 *l = raw.data(), *r = raw.data() + raw.size();
+		if((res.error = trimLR(l, r)) != Err::NONE) return res;
 
 		std::vector<u8> stream;
-		stream.reserve(r - l);
-		if((last_error = decode(l, r, stream)) != Err::NONE) return {};
+		if((res.error = decode(l, r, stream)) != Err::NONE) return res;
 
-		std::vector<u8> res;
-		if((last_error = extract(stream, res)) != Err::NONE) return {};
+		res.error = extract(stream, res, verify);
+		return res;
+	}
 
+	// 空いたスレッドが次のファイルを取っていく 結果は paths と同じ順番
+	std::vector<Result> parseFiles(const std::vector<std::string> & paths, const u32 threads, const bool verify){
+		std::vector<Result> res(paths.size());
+		std::atomic<size_t> next = 0;
+		const auto work = [&]{
+			for(size_t i; (i = next++) < paths.size();) res[i] = parse(paths[i], verify);
+		};
+		std::vector<std::thread> workers;
+		for(size_t t = 1; t < std::min<size_t>(threads, paths.size()); ++t) workers.emplace_back(work);
+		work();
+		for(auto & th : workers) th.join();
 		return res;
 	}
+
+	std::vector<u8> read(const std::string & path){
+		const MappedFile raw(path, MappedFile::Access::SEQUENTIAL);
+		return read(raw.span());
+	}
+
+	std::vector<u8> read(std::span<const u8> raw){
+		Result res = parse(raw, check_crc);
+		last_FileName = std::move(res.FileName);
+		last_Version = res.Version;
+		last_Type = std::move(res.Type);
+		last_Creator = std::move(res.Creator);
+		last_Flags = res.Flags;
+		last_Resource = std::move(res.resource);
+		last_error = res.error;
+
+		// CRC_ERROR の場合は取り出せた内容をそのまま返す
+		if(last_error != Err::NONE && last_error != Err::CRC_ERROR) return {};
+		return std::move(res.data);
+	}
 }
 
 /*
@@ -36,6 +36,7 @@ public:
 	BMP(const std::string & path){ read(path); }
 
 	Err read(const std::string & path);
+	Err read(std::span<const u8> src);
 	void write(const std::string & path);
 
 	u32 H, W;
@@ -47,9 +48,9 @@ protected:
 
 	std::vector<u8> BMPstream;
 
-	Err read_FILEHEADER(std::vector<u8>::const_iterator &);
-	Err read_INFOHEADER(std::vector<u8>::const_iterator &);
-	Err read_BITMAP(std::vector<u8>::const_iterator &);
+	Err read_FILEHEADER(const u8* &);
+	Err read_INFOHEADER(const u8* &);
+	Err read_BITMAP(const u8* &, const u8* end);
 
 	void write_FILEHEADER(std::vector<u8>::iterator &);
 	void write_INFOHEADER(std::vector<u8>::iterator &);
@@ -67,17 +68,21 @@ BMP & BMP::operator=(const BMP & other){
 }
 
 BMP::Err BMP::read(const std::string & path){
-	BMPstream = readFile(path);
-	if(BMPstream.size() < BMP_MINIMUM_SIZE) return Err::UNRECOGNIZABLE;
-	std::vector<u8>::const_iterator itr = BMPstream.begin();
+	const MappedFile file(path, MappedFile::Access::SEQUENTIAL);
+	return read(file.span());
+}
+
+BMP::Err BMP::read(std::span<const u8> stream){
+	if(stream.size() < BMP_MINIMUM_SIZE) return Err::UNRECOGNIZABLE;
+	const u8* itr = stream.data();
 	Err e = Err::NONE;
 	if((e = read_FILEHEADER(itr)) != Err::NONE) return e;
 	if((e = read_INFOHEADER(itr)) != Err::NONE) return e;
-	if((e = read_BITMAP(itr)) != Err::NONE) return e;
+	if((e = read_BITMAP(itr, stream.data() + stream.size())) != Err::NONE) return e;
 	return e;
 }
 
-BMP::Err BMP::read_FILEHEADER(std::vector<u8>::const_iterator & itr){
+BMP::Err BMP::read_FILEHEADER(const u8* & itr){
 	if(std::string(itr, itr + 2) != "BM") return Err::UNKNOWN_TYPE;
 	itr += 2;
 	u32 bfSize = readLE<u32>(itr);
@@ -87,7 +92,7 @@ BMP::Err BMP::read_FILEHEADER(std::vector<u8>::const_iterator & itr){
 	return Err::NONE;
 }
 
-BMP::Err BMP::read_INFOHEADER(std::vector<u8>::const_iterator & itr){
+BMP::Err BMP::read_INFOHEADER(const u8* & itr){
 	u32 biSize = readLE<u32>(itr);
 	if(biSize != BMP_INFOHEADER_SIZE) return Err::UNSUPPORTED_INFOHEADER;
 	W = readLE<u32>(itr);
@@ -107,10 +112,10 @@ BMP::Err BMP::read_INFOHEADER(std::vector<u8>::const_iterator & itr){
 	return Err::NONE;
 }
 
-BMP::Err BMP::read_BITMAP(std::vector<u8>::const_iterator & itr){
+BMP::Err BMP::read_BITMAP(const u8* & itr, const u8* const end){
 	data = Image_RGB8(H, W);
 	u8 rest = W & 0b11;
-	if((W * 3 + rest) * H > BMPstream.end() - itr) return Err::UNRECOGNIZABLE;
+	if((W * 3 + rest) * H > end - itr) return Err::UNRECOGNIZABLE;
 	for(u32 h = H; h-- > 0;){
 		for(u32 w = 0; w < W; ++w){
 			data[h][w].B = *itr++;
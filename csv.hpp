@@ -1,16 +1,35 @@
+#ifndef CSV_HPP
+#define CSV_HPP
+
+#include <barrier>
+#include <charconv>
+#include <climits>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <string_view>
+#include <thread>
+
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+#include <zlib.h>
+
 #include "file.hpp"
+#include "float.hpp"
 
+// gzip の読み書きに zlib を使うので、コンパイル時に -lz を指定してください
 class CSV{
 public:
 	CSV(){}
 	CSV(const std::vector<std::vector<std::string>> & init_data) : data(init_data){}
-	CSV(const CSV & csv) : data(csv.data) {}
 	CSV(const std::string & path){
 		read(path);
 	}
 
 	inline std::vector<std::string> & operator[](const size_t h){ return data[h]; }
-	size_t size() const{ return data.size(); }
+	size_t size() const{ return cols.empty() ? data.size() : rows; }
 	auto begin(){ return data.begin(); }
 	auto end(){ return data.end(); }
 	auto begin() const{ return data.begin();}
@@ -24,94 +43,701 @@ public:
 
 	enum class Err{
 		NONE,
-		WARN
+		WARN,
+		STALE_INDEX, // read_range に渡した索引が今のファイルと合わない (大きさか更新時刻が違う)
+		GZIP // gzip を展開できなかった (壊れている・途中で切れている・zlib の初期化に失敗した) 展開できた所までの行は残る
 	} err;
 
+	enum class Type{
+		STRING,
+		I64,
+		U64,
+		F64,
+		BOOL, // true/false (1/0 も受け付ける)
+		DICT // 辞書符号化した文字列 (種類の少ない列向け)
+	};
+
+	// 使用メモリ量の目安 (バイト)
+	struct Memory{
+		size_t used = 0;
+		size_t as_strings = 0; // 全セルを std::string で持った場合
+	};
+
+	// 型付きで読み込んだ列
+	// type に対応する配列だけが使われる
+	struct Column{
+		std::string name;
+		Type type = Type::STRING;
+		std::vector<std::string> strings;
+		std::vector<i64> i64s;
+		std::vector<u64> u64s;
+		std::vector<f64> f64s;
+		std::vector<u8> bools;
+		size_t errors = 0; // 変換に失敗したセルの数 (値は0になる)
+
+		// DICT: セルごとに code_width (1, 2, 4) バイトの符号を持つ
+		// 種類が増えると符号の幅を広げる
+		std::vector<u8> codes;
+		u8 code_width = 1;
+		std::vector<std::string> dict;
+
+		size_t size() const{
+			switch(type){
+				case Type::I64: return i64s.size();
+				case Type::U64: return u64s.size();
+				case Type::F64: return f64s.size();
+				case Type::BOOL: return bools.size();
+				case Type::DICT: return codes.size() / code_width;
+				default: return strings.size();
+			}
+		}
+		// 足りないセルは既定値で埋める
+		void resize(const size_t n){
+			switch(type){
+				case Type::I64: i64s.resize(n); break;
+				case Type::U64: u64s.resize(n); break;
+				case Type::F64: f64s.resize(n); break;
+				case Type::BOOL: bools.resize(n); break;
+				case Type::DICT:
+					if(n > size()){
+						const u32 c = intern("");
+						while(size() < n) push_code(c);
+					}
+					else codes.resize(n * code_width);
+					break;
+				default: strings.resize(n); break;
+			}
+		}
+
+		// 符号はリトルエンディアンで並べる
+		u32 code(const size_t h) const{
+			const u8* p = codes.data() + h * code_width;
+			if(code_width == 1) return *p;
+			u32 c = 0;
+			for(u8 i = 0; i < code_width; ++i) c |= u32(p[i]) << (i * 8);
+			return c;
+		}
+		std::string_view decode(const u32 c) const{ return dict[c]; }
+		std::string_view at(const size_t h) const{ return dict[code(h)]; }
+
+		// 値を辞書に登録して符号を返す
+		u32 intern(const std::string_view v){
+			if((dict.size() + 1) * 2 > dict_slots.size()) rehash(std::max<size_t>(dict_slots.size() * 2, 16));
+			const size_t mask = dict_slots.size() - 1;
+			for(size_t i = std::hash<std::string_view>()(v) & mask; ; i = (i + 1) & mask){
+				const u32 c = dict_slots[i];
+				if(c == U32MAX){
+					dict_slots[i] = dict.size();
+					dict.emplace_back(v);
+					return dict_slots[i];
+				}
+				if(dict[c] == v) return c;
+			}
+		}
+		void push_code(const u32 c){
+			if(code_width < 4 && c >> (code_width * 8) != 0) widen(code_width == 1 ? 2 : 4);
+			const size_t n = codes.size();
+			codes.resize(n + code_width);
+			store_code(codes.data() + n, c, code_width);
+		}
+
+		Memory memory() const{
+			static const size_t sso = std::string().capacity();
+			auto heap = [](const std::string & str){ return str.capacity() > sso ? str.capacity() + 1 : 0; };
+			Memory m;
+			m.used = i64s.capacity() * sizeof(i64) + u64s.capacity() * sizeof(u64)
+				+ f64s.capacity() * sizeof(f64) + bools.capacity() + codes.capacity()
+				+ (strings.capacity() + dict.capacity()) * sizeof(std::string) + dict_slots.capacity() * sizeof(u32);
+			for(const std::string & str : strings) m.used += heap(str);
+			for(const std::string & str : dict) m.used += heap(str);
+			m.as_strings = size() * sizeof(std::string);
+			if(type == Type::DICT){
+				std::vector<size_t> count(dict.size());
+				for(size_t h = 0; h < size(); ++h) count[code(h)] ++;
+				for(size_t c = 0; c < dict.size(); ++c) m.as_strings += count[c] * (dict[c].size() > sso ? dict[c].size() + 1 : 0);
+			}
+			else if(type == Type::STRING){
+				for(const std::string & str : strings) m.as_strings += heap(str);
+			}
+			return m;
+		}
+
+	private:
+		// dict の添字を入れる開番地法の表 (空きは U32MAX)
+		// 文字列は dict にしか持たないので、複製しても添字がずれることはない
+		std::vector<u32> dict_slots;
+
+		void rehash(const size_t n){
+			dict_slots.assign(n, U32MAX);
+			for(u32 c = 0; c < dict.size(); ++c){
+				size_t i = std::hash<std::string_view>()(dict[c]) & (n - 1);
+				while(dict_slots[i] != U32MAX) i = (i + 1) & (n - 1);
+				dict_slots[i] = c;
+			}
+		}
+
+		static void store_code(u8* const p, const u32 c, const u8 width){
+			for(u8 i = 0; i < width; ++i) p[i] = u8(c >> (i * 8));
+		}
+
+		void widen(const u8 width){
+			const size_t n = size();
+			std::vector<u8> wide(n * width);
+			for(size_t h = 0; h < n; ++h) store_code(wide.data() + h * width, code(h), width);
+			codes.swap(wide);
+			code_width = width;
+		}
+	};
+
+	struct ReadOptions{
+		bool header = false; // 先頭行を列名として扱う
+		std::vector<Type> schema; // 列の型 (足りない列は STRING)
+		u32 infer_rows = 0; // 0でなければ schema にない列の型を先頭の infer_rows 行から推定する
+		// 読み込む列 (元の列番号か列名) 両方空なら全列
+		// 選ばれなかった列は文字列にすらならない
+		std::vector<size_t> select;
+		std::vector<std::string> select_names; // header = true のときのみ
+		// filter が false を返した行は捨てる (ヘッダ行には適用しない)
+		// filter_column は元の列番号 以降の列はその行では読まれない
+		size_t filter_column = 0;
+		std::function<bool(std::string_view)> filter;
+		ReadOptions() {}
+	};
+
 	struct WriteOptions{
 		bool align_width = true;
 		u32 min_width = 0;
 		bool all_dquote = false;
+		u32 threads = 1; // 行の整形を並列に行うスレッド数
+		size_t block_rows = 4096; // 1スレッドが一度に整形する行数 (threads * block_rows 行ごとに書き出す)
+		bool atomic = false; // 一時ファイルに書いてから置き換える
+		bool gzip = false; // 書き出すブロックごとに deflate して gzip 形式で書く
+		u8 gzip_level = 6; // 圧縮レベル(0~9)
 		WriteOptions() {}
 	};
 
-	Err read(const std::string & path){
-		err = Err::NONE;
-		warn = Warn::NONE;
-		std::vector<u8> src = readFile(path);
-		data = {{}};
-		reader_init(src);
-		while(reader.now != reader.end){
-			u8 c = *reader.now;
-			if(c == '"') read_dquote();
-			else read_normal();
-			if(reader.now == reader.end) break;
-			c = *reader.now;
-			if(c == ',') read_comma();
-			else if(c == '\r' || c == '\n') read_br();
-			else{
-				// unexpected
+	// schema か infer_rows を指定すると列ごとの型付き配列として読む (columns() で参照)
+	// ファイルは mmap して読む
+	Err read(const std::string & path, const ReadOptions & r_op = {}){
+		const MappedFile src(path, MappedFile::Access::SEQUENTIAL);
+		return read(src.span(), r_op);
+	}
+	// gzip 形式なら展開しながら少しずつ読む
+	Err read(const std::span<const u8> src, const ReadOptions & r_op = {}){
+		if(src.size() >= 2 && src[0] == 0x1F && src[1] == 0x8B) return read_gzip(src, r_op);
+		return read_bytes(src.data(), src.data() + src.size(), r_op);
+	}
+
+	const std::vector<Column> & columns() const{ return cols; }
+	const Column & column(const size_t c) const{ return cols[c]; }
+
+	Memory memory() const{
+		Memory m;
+		for(const Column & col : cols){
+			const Memory cm = col.memory();
+			m.used += cm.used;
+			m.as_strings += cm.as_strings;
+		}
+		static const size_t sso = std::string().capacity();
+		for(const auto & row : data){
+			size_t sz = row.capacity() * sizeof(std::string);
+			for(const std::string & str : row) sz += str.capacity() > sso ? str.capacity() + 1 : 0;
+			m.used += sz;
+			m.as_strings += sz;
+		}
+		return m;
+	}
+
+	// 行の位置の索引 (stride 行ごとに行頭のバイト位置を記録する)
+	// 記録するのは行頭なので、その位置は必ず""の外側にある
+	// 行番号はヘッダ行も含めたファイル上の行 (連続する改行は一つとみなす)
+	struct Index{
+		u32 stride = 1024;
+		u64 file_size = 0;
+		i64 mtime = 0;
+		u64 rows = 0;
+		std::vector<u64> offsets; // offsets[k]: k * stride 行目の先頭
+
+		static constexpr u32 version = 1;
+
+		// 索引を作った時からファイルが変わっていないか
+		bool matches(const std::string & csv_path) const{
+			std::error_code ec;
+			const u64 sz = std::filesystem::file_size(csv_path, ec);
+			if(ec) return false;
+			const i64 mt = std::filesystem::last_write_time(csv_path, ec).time_since_epoch().count();
+			if(ec) return false;
+			return sz == file_size && mt == mtime;
+		}
+
+		void save(const std::string & path) const{
+			std::vector<u8> stream(4 + 4 + 4 + 8 * 4 + 8 * offsets.size());
+			auto itr = stream.begin();
+			writeString(itr, "CSVI");
+			writeLE<u32>(itr, version);
+			writeLE<u32>(itr, stride);
+			writeLE<u64>(itr, file_size);
+			writeLE<i64>(itr, mtime);
+			writeLE<u64>(itr, rows);
+			writeLE<u64>(itr, offsets.size());
+			for(const u64 ofs : offsets) writeLE<u64>(itr, ofs);
+			writeFile(path, stream);
+		}
+
+		bool load(const std::string & path){
+			const std::vector<u8> stream = readFile(path);
+			if(stream.size() < 44) return false;
+			auto itr = stream.begin();
+			if(readString(itr, 4) != "CSVI") return false;
+			if(readLE<u32>(itr) != version) return false;
+			stride = readLE<u32>(itr);
+			file_size = readLE<u64>(itr);
+			mtime = readLE<i64>(itr);
+			rows = readLE<u64>(itr);
+			const u64 count = readLE<u64>(itr);
+			if(stride == 0 || stream.size() - 44 != count * 8) return false;
+			offsets.resize(count);
+			for(u64 & ofs : offsets) ofs = readLE<u64>(itr);
+			return true;
+		}
+	};
+
+	static Index build_index(const std::string & path, const u32 stride = 1024){
+		Index index;
+		index.stride = std::max<u32>(stride, 1);
+		std::error_code ec;
+		index.mtime = std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+		const MappedFile src(path, MappedFile::Access::SEQUENTIAL);
+		index.file_size = src.size();
+		const u8 *p = src.data(), *end = p + src.size();
+		while(p != end){
+			if(index.rows % index.stride == 0) index.offsets.push_back(p - src.data());
+			p = scan_row(p, end);
+			index.rows ++;
+		}
+		return index;
+	}
+
+	// path + ".idx" の索引が有効ならそれを読み、そうでなければ作って保存する
+	static Index open_index(const std::string & path, const u32 stride = 1024){
+		Index index;
+		if(index.load(path + ".idx") && index.matches(path)) return index;
+		index = build_index(path, stride);
+		index.save(path + ".idx");
+		return index;
+	}
+
+	// 索引を使って first 行目から count 行だけを読む
+	// 含まれるブロックにしか触れない r_op.header のときはヘッダ行を除いた行番号
+	// 索引を作った後にファイルが変わっていれば何も読まずに Err::STALE_INDEX を返す
+	Err read_range(const std::string & path, const Index & index, size_t first, size_t count, const ReadOptions & r_op = {}){
+		if(!index.matches(path)){
+			read_bytes(nullptr, nullptr, r_op);
+			return err = Err::STALE_INDEX;
+		}
+		const MappedFile map(path, MappedFile::Access::RANDOM);
+		if(map.size() != index.file_size){
+			read_bytes(nullptr, nullptr, r_op);
+			return err = Err::STALE_INDEX;
+		}
+		const u8 *l = map.data(), *r = map.data();
+		if(first + (r_op.header ? 1 : 0) < index.rows && count > 0){
+			if(r_op.header) first ++;
+			count = std::min<size_t>(count, index.rows - first);
+			const size_t b = first / index.stride, b_end = (first + count - 1) / index.stride + 1;
+			l = map.data() + index.offsets[b];
+			r = b_end < index.offsets.size() ? map.data() + index.offsets[b_end] : map.end();
+			for(size_t h = b * index.stride; h < first; ++h) l = scan_row(l, r);
+		}
+		else count = 0;
+		if(!r_op.header) return read_bytes(l, r, r_op, count);
+		// ヘッダ行だけは前に繋げる
+		std::vector<u8> src(map.data(), scan_row(map.data(), map.end()));
+		src.insert(src.end(), l, r);
+		return read_bytes(src.data(), src.data() + src.size(), r_op, count + 1);
+	}
+
+	// 行をブロックごとに大きさを確定させてから整形し、順に書き出す
+	// 書き出しか gzip の準備に失敗したら false (atomic なら元のファイルは残る)
+	bool write(const std::string & path, WriteOptions w_op = {}){
+		const size_t total = write_rows();
+		if(w_op.align_width)
+			for(size_t h = 0; h < total; ++h)
+				if(write_cells(h) > w_op.min_width)
+					w_op.min_width = write_cells(h);
+		const u32 threads = std::max<u32>(w_op.threads, 1);
+		const size_t block_rows = std::max<size_t>(w_op.block_rows, 1);
+		std::vector<WriteBlock> blocks(threads);
+		size_t h = 0;
+		auto task = [&](const u32 t){
+			const size_t l = std::min(total, h + block_rows * t);
+			const size_t r = std::min(total, l + block_rows);
+			write_block(l, r, total, w_op, blocks[t]);
+		};
+		// スレッドは最初に一度だけ立て、区切りごとに barrier で揃える
+		// 1回目の arrive_and_wait で h を受け取って整形し、2回目で書き出し側に渡す
+		bool stop = false;
+		std::barrier sync(threads);
+		std::vector<std::thread> pool;
+		for(u32 t = 1; t < threads; ++t) pool.emplace_back([&](const u32 t){
+			while(true){
+				sync.arrive_and_wait();
+				if(stop) return;
+				task(t);
+				sync.arrive_and_wait();
+			}
+		}, t);
+		// ファイルは1回目の整形が終わってから開き、その大きさから全体の大きさを見積もって領域を確保する
+		std::optional<WriteSink> out;
+		for(; h < total; h += block_rows * threads){
+			sync.arrive_and_wait();
+			task(0);
+			sync.arrive_and_wait();
+			if(!out){
+				size_t bytes = 0;
+				for(const WriteBlock & block : blocks) bytes += block.out.size();
+				const size_t done = std::min(total, block_rows * threads);
+				out.emplace(path, w_op, static_cast<size_t>(static_cast<f64>(bytes) * total / done));
 			}
+			out->put(blocks);
+		}
+		stop = true;
+		sync.arrive_and_wait();
+		for(auto & th : pool) th.join();
+		if(!out) out.emplace(path, w_op, 0);
+		return out->close();
+	}
+
+
+	template<typename T>
+	static bool parse_number(std::string_view v, T & x){
+		const char *l = v.data(), *r = l + v.size();
+		if(l != r && *l == '+') l ++;
+		auto [p, ec] = std::from_chars(l, r, x);
+		if(ec == std::errc() && p == r) return true;
+		x = 0;
+		return false;
+	}
+	static bool parse_bool(std::string_view v, u8 & x){
+		x = 0;
+		if(v == "true" || v == "TRUE" || v == "True" || v == "1"){
+			x = 1;
+			return true;
 		}
+		return v == "false" || v == "FALSE" || v == "False" || v == "0";
+	}
+
+
+private:
+
+	std::vector<std::vector<std::string>> data = {{}};
+
+	std::vector<Column> cols;
+	size_t rows = 0;
+
+	struct ReadContext{
+		const u8 *l, *now, *end;
+		bool column_mode;
+		bool header; // ヘッダ行を読んでいる
+		bool skip; // 今の行は捨てる
+		size_t col; // 行内で何番目のフィールドか
+		size_t rows_left; // あと何行読むか
+		std::vector<Type> schema;
+		std::vector<size_t> out; // 元の列番号 -> 出力先の列番号 (SIZE_MAX: 読まない)
+		bool select_all;
+		size_t filter_column;
+		std::function<bool(std::string_view)> filter;
+		std::string buf; // エスケープを含むフィールドの展開先
+	} reader;
+	void reader_init(const u8* begin, const u8* end){
+		reader.now = reader.l = begin;
+		reader.end = end;
+		reader.col = 0;
+	}
+
+	Err read_bytes(const u8* begin, const u8* end, const ReadOptions & r_op, const size_t row_limit = SIZE_MAX){
+		read_prepare(begin, end, r_op, row_limit);
+		reader_init(begin, end);
+		read_rows();
+		return read_finish();
+	}
+
+	// [begin, end) は select_names や型推定に使う先頭部分
+	void read_prepare(const u8* begin, const u8* end, const ReadOptions & r_op, const size_t row_limit){
+		err = Err::NONE;
+		warn = Warn::NONE;
+		data.clear();
+		cols.clear();
+		rows = 0;
+		reader.column_mode = !r_op.schema.empty() || r_op.infer_rows > 0;
+		reader.header = r_op.header;
+		reader.schema = r_op.schema;
+		reader.filter_column = r_op.filter_column;
+		reader.filter = r_op.filter;
+		reader.select_all = r_op.select.empty() && r_op.select_names.empty();
+		if(!reader.select_all) read_select(begin, end, r_op);
+		if(r_op.infer_rows > 0) infer_schema(begin, end, r_op);
+		reader.rows_left = row_limit;
+	}
+
+	Err read_finish(){
+		if(!reader.column_mode && data.empty()) data = {{}};
 		if(err == Err::NONE && warn != Warn::NONE){
 			err = Err::WARN;
 		}
 		return err;
 	}
 
-	void write(const std::string & path, WriteOptions w_op = {}){
-		std::vector<u8> stream;
-		if(w_op.align_width)
-			for(const auto & row : data)
-				if(row.size() > w_op.min_width)
-					w_op.min_width = row.size();
-		for(const auto & row : data){
-			bool first = true;
-			for(const std::string & el : row){
-				if(!first) stream.push_back(',');
-				first = false;
-				bool dquote_temp = w_op.all_dquote;
-				if(!dquote_temp){
-					for(const char c : el){
-						if(c == ',' || c == '"' || c == '\r' || c == '\n'){
-							dquote_temp = true;
-							break;
-						}
-					}
+	// 展開したデータをバッファに溜め、完全な行が揃った分だけ read_rows に渡す
+	// 行がバッファに収まらない時だけバッファを広げる
+	Err read_gzip(const std::span<const u8> src, const ReadOptions & r_op){
+		z_stream z; z.zalloc = Z_NULL; z.zfree = Z_NULL; z.opaque = Z_NULL;
+		// avail_in は 32bit なので、入力は UINT_MAX バイトずつ渡す
+		const u8* in = src.data();
+		size_t rest = src.size();
+		auto refill = [&](){
+			if(z.avail_in > 0 || rest == 0) return;
+			z.next_in = const_cast<u8*>(in);
+			z.avail_in = std::min<size_t>(rest, UINT_MAX);
+			in += z.avail_in;
+			rest -= z.avail_in;
+		};
+		z.next_in = Z_NULL;
+		z.avail_in = 0;
+		refill();
+		if(inflateInit2(&z, 15 + 16) != Z_OK){
+			read_prepare(nullptr, nullptr, r_op, SIZE_MAX);
+			read_finish();
+			return err = Err::GZIP;
+		}
+		std::vector<u8> buf(1 << 20);
+		size_t filled = 0;
+		bool prepared = false, final = false, broken = false;
+		while(!final){
+			if(filled == buf.size()) buf.resize(buf.size() * 2);
+			z.next_out = buf.data() + filled;
+			z.avail_out = buf.size() - filled;
+			refill();
+			int ret = inflate(&z, Z_NO_FLUSH);
+			filled = buf.size() - z.avail_out;
+			if(ret == Z_STREAM_END){
+				// 複数のメンバーが連結されていれば続けて展開する
+				if(z.avail_in > 0 || rest > 0) inflateReset(&z);
+				else final = true;
+			}
+			// Z_STREAM_END に届かずに入力が尽きたら途中で切れている
+			else if((ret != Z_OK && ret != Z_BUF_ERROR) || (z.avail_in == 0 && rest == 0 && z.avail_out > 0)){
+				broken = true;
+				final = true;
+			}
+
+			const u8 *begin = buf.data(), *end = begin + filled, *last = begin;
+			while(last != end){
+				const u8* next = scan_row(last, end, final);
+				if(next == nullptr) break;
+				last = next;
+			}
+			if(last == begin && !final) continue;
+			if(!prepared){
+				read_prepare(begin, last, r_op, SIZE_MAX);
+				prepared = true;
+			}
+			reader_init(begin, last);
+			read_rows();
+			std::copy(last, end, buf.begin());
+			filled = end - last;
+			if(reader.rows_left == 0) break;
+		}
+		inflateEnd(&z);
+		if(!prepared) read_prepare(nullptr, nullptr, r_op, SIZE_MAX);
+		read_finish();
+		if(broken) err = Err::GZIP;
+		return err;
+	}
+
+	// 先頭の infer_rows 行を文字列として読み、各列が収まる最も狭い型を選ぶ
+	void infer_schema(const u8* begin, const u8* end, const ReadOptions & r_op){
+		CSV sample;
+		ReadOptions s_op = r_op;
+		s_op.schema.clear();
+		s_op.infer_rows = 0;
+		sample.read_bytes(begin, end, s_op, r_op.infer_rows + (r_op.header ? 1 : 0));
+		std::vector<u8> can_i64, can_u64, can_f64, can_bool, seen;
+		for(size_t h = r_op.header ? 1 : 0; h < sample.data.size(); ++h){
+			const auto & row = sample.data[h];
+			if(row.size() > seen.size()){
+				can_i64.resize(row.size(), 1);
+				can_u64.resize(row.size(), 1);
+				can_f64.resize(row.size(), 1);
+				can_bool.resize(row.size(), 1);
+				seen.resize(row.size(), 0);
+			}
+			for(size_t c = 0; c < row.size(); ++c){
+				if(row[c].empty()) continue;
+				seen[c] = 1;
+				i64 i; u64 u; f64 f; u8 b;
+				can_i64[c] &= parse_number(row[c], i);
+				can_u64[c] &= parse_number(row[c], u);
+				can_f64[c] &= parse_number(row[c], f);
+				can_bool[c] &= row[c] != "1" && row[c] != "0" && parse_bool(row[c], b);
+			}
+		}
+		if(reader.schema.size() < seen.size()) reader.schema.resize(seen.size(), Type::STRING);
+		for(size_t c = r_op.schema.size(); c < seen.size(); ++c){
+			if(!seen[c]) continue;
+			if(can_i64[c]) reader.schema[c] = Type::I64;
+			else if(can_u64[c]) reader.schema[c] = Type::U64;
+			else if(can_f64[c]) reader.schema[c] = Type::F64;
+			else if(can_bool[c]) reader.schema[c] = Type::BOOL;
+		}
+	}
+
+	// 読み込む列を元の列番号の昇順に並べ、出力先の列番号を割り当てる
+	void read_select(const u8* begin, const u8* end, const ReadOptions & r_op){
+		std::vector<size_t> index = r_op.select;
+		if(r_op.header && !r_op.select_names.empty()){
+			CSV head;
+			head.read_bytes(begin, end, {}, 1);
+			const auto & names = head.data[0];
+			for(const std::string & name : r_op.select_names){
+				auto itr = std::find(names.begin(), names.end(), name);
+				if(itr != names.end()) index.push_back(itr - names.begin());
+			}
+		}
+		std::sort(index.begin(), index.end());
+		index.erase(std::unique(index.begin(), index.end()), index.end());
+		reader.out.assign(index.empty() ? 0 : index.back() + 1, SIZE_MAX);
+		for(size_t i = 0; i < index.size(); ++i) reader.out[index[i]] = i;
+	}
+
+	inline size_t read_out(const size_t c) const{
+		if(reader.select_all) return c;
+		return c < reader.out.size() ? reader.out[c] : SIZE_MAX;
+	}
+	// 今のフィールドを展開する必要があるか
+	inline bool read_wanted() const{
+		if(reader.skip) return false;
+		if(reader.filter && reader.col == reader.filter_column) return true;
+		return read_out(reader.col) != SIZE_MAX;
+	}
+
+	// p から始まる行の次の行の先頭を返す (read_rows と同じ規則で区切る)
+	// final でなければ、続きのデータ次第で区切りが変わりうるとき nullptr を返す
+	static const u8* scan_row(const u8* p, const u8* end, const bool final = true){
+		const u8* const unknown = final ? end : nullptr;
+		while(p != end){
+			if(*p == '"'){
+				p ++;
+				while(true){
+					p = static_cast<const u8*>(std::memchr(p, '"', end - p));
+					if(p == nullptr || p + 1 == end) return unknown;
+					p ++;
+					if(*p != '"') break;
+					p ++;
 				}
-				if(dquote_temp){
-					stream.push_back('"');
-					for(const char c : el){
-						stream.push_back(c);
-						if(c == '"') stream.push_back('"');
-					}
-					stream.push_back('"');
+			}
+			while(p != end && *p != ',' && *p != '\r' && *p != '\n') p ++;
+			if(p == end) return unknown;
+			if(*p == ','){
+				if(++p == end) return unknown;
+				continue;
+			}
+			while(p != end && (*p == '\r' || *p == '\n')) p ++;
+			if(p == end) return unknown;
+			return p;
+		}
+		return unknown;
+	}
+
+	// 行を読めるだけ読む
+	void read_rows(){
+		while(reader.now != reader.end && reader.rows_left > 0){
+			read_row_begin();
+			while(true){
+				u8 c = *reader.now;
+				if(c == '"') read_dquote();
+				else read_normal();
+				if(reader.now == reader.end) break;
+				c = *reader.now;
+				if(c == ','){
+					read_comma();
+					if(reader.now == reader.end) break;
+				}
+				else if(c == '\r' || c == '\n'){
+					read_br();
+					break;
 				}
 				else{
-					stream.insert(stream.end(), el.begin(), el.end());
+					// unexpected
 				}
 			}
-			if(w_op.min_width)
-				if(row.size() < w_op.min_width)
-					stream.insert(stream.end(), w_op.min_width - row.size(), ',');
-			stream.push_back('\r');
-			stream.push_back('\n');
+			read_row_end();
 		}
-		stream.pop_back();
-		stream.pop_back();
-		writeFile(path, stream);
 	}
 
+	inline void read_row_begin(){
+		reader.col = 0;
+		reader.skip = false;
+		if(!reader.column_mode) data.emplace_back();
+	}
+	inline void read_row_end(){
+		reader.rows_left --;
+		const bool header = reader.header;
+		reader.header = false;
+		if(!reader.column_mode || header || reader.skip) return;
+		rows ++;
+		for(Column & col : cols)
+			if(col.size() < rows) col.resize(rows);
+	}
 
-private:
+	// 行を捨てる ここまでに読んだフィールドも取り消す
+	inline void read_row_reject(){
+		reader.skip = true;
+		if(!reader.column_mode){
+			data.pop_back();
+			return;
+		}
+		for(Column & col : cols)
+			if(col.size() > rows) col.resize(rows);
+	}
 
-	std::vector<std::vector<std::string>> data = {{}};
+	// フィールドを一つ受け取る
+	inline void read_field(const std::string_view v){
+		const size_t c = reader.col ++;
+		if(reader.skip) return;
+		if(reader.filter && c == reader.filter_column && !reader.header && !reader.filter(v)){
+			read_row_reject();
+			return;
+		}
+		const size_t o = read_out(c);
+		if(o == SIZE_MAX) return;
+		if(!reader.column_mode){
+			data.back().emplace_back(v);
+			return;
+		}
+		while(o >= cols.size()) add_column();
+		if(reader.header) cols[o].name = v;
+		else push_cell(cols[o], v);
+	}
 
-	struct ReadContext{
-		std::vector<u8>::iterator l, now, end;
-	} reader;
-	void reader_init(std::vector<u8> & src){
-		reader.now = reader.l = src.begin();
-		reader.end = src.end();
+	void add_column(){
+		const size_t c = cols.size();
+		cols.emplace_back();
+		cols[c].type = c < reader.schema.size() ? reader.schema[c] : Type::STRING;
+		cols[c].resize(rows);
+	}
+
+	static void push_cell(Column & col, const std::string_view v){
+		bool ok = true;
+		switch(col.type){
+			case Type::I64: ok = parse_number(v, col.i64s.emplace_back()); break;
+			case Type::U64: ok = parse_number(v, col.u64s.emplace_back()); break;
+			case Type::F64: ok = parse_number(v, col.f64s.emplace_back()); break;
+			case Type::BOOL: ok = parse_bool(v, col.bools.emplace_back()); break;
+			case Type::DICT: col.push_code(col.intern(v)); break;
+			default: col.strings.emplace_back(v); break;
+		}
+		if(!ok) col.errors ++;
 	}
 
 	// カンマまたは改行の位置まで進める
@@ -124,26 +750,34 @@ private:
 		return;
 	}
 
-	// ノーマルフィールドでデータを追加
-	inline void read_push(){
-		data.back().emplace_back(reader.l, reader.now);
-	}
 	// ノーマルフィールドを処理
 	inline void read_normal(){
+		reader.l = reader.now;
 		read_proceed();
-		read_push();
+		if(!read_wanted()){
+			reader.col ++;
+			return;
+		}
+		read_field(std::string_view(reinterpret_cast<const char*>(reader.l), reader.now - reader.l));
 	}
 
-	// クォーテーションフィールドでデータを足す
-	inline void read_add(){
-		data.back().back() += std::string(reader.l, reader.now);
+	// クォーテーションフィールドの中身を確定させる
+	// エスケープが無ければ元のバイト列をそのまま渡す
+	inline std::string_view read_dquote_view(const bool escaped){
+		const char* l = reinterpret_cast<const char*>(reader.l);
+		const size_t n = reader.now - reader.l;
+		if(!escaped) return std::string_view(l, n);
+		reader.buf.append(l, n);
+		return reader.buf;
 	}
 
 	// クォーテーションフィールドの処理の中核
 	inline void read_dquote_inner(){
+		const bool wanted = read_wanted();
+		bool escaped = false;
+		reader.buf.clear();
 		for(; reader.now < reader.end; ++reader.now){
 			if(*reader.now == '"'){
-				read_add();
 				u8 nextc = '\r';
 				bool close = false;
 				close |= reader.now + 1 == reader.end;
@@ -152,55 +786,259 @@ private:
 					close |= nextc != '"';
 				}
 				if(close){
+					const std::string_view v = wanted ? read_dquote_view(escaped) : std::string_view();
 					reader.now ++;
 					if(nextc != ',' && nextc != '\r' && nextc != '\n'){
 						warn = Warn::UNEXPECT_AFTER_DQUOTE;
 						read_proceed();
 					}
+					if(wanted) read_field(v);
+					else reader.col ++;
 					return;
 				}
 				else{
-					data.back().back().push_back('"');
+					escaped = true;
+					if(wanted) reader.buf.append(reinterpret_cast<const char*>(reader.l), reader.now + 1 - reader.l);
 					reader.now ++;
 					reader.l = reader.now + 1;
 				}
 			}
 		}
 		warn = Warn::UNCLOSED_DQUOTE;
-		read_add();
+		if(wanted) read_field(read_dquote_view(escaped));
+		else reader.col ++;
 	}
 	// クォーテーションフィールドを処理
 	inline void read_dquote(){
 		reader.now ++;
 		reader.l = reader.now;
-		data.back().push_back("");
 		read_dquote_inner();
 	}
 
-	// 改行を処理
+	// 改行を処理 (連続する改行は一つにまとめる)
 	inline void read_br(){
-		while(reader.now + 1 < reader.end){
-			u8 nextc = *(reader.now + 1);
-			if(
-				*reader.now == '\r' && nextc == '\n' ||
-				*reader.now == '\n' && nextc == '\r'
-			) reader.now ++;
-			if(reader.now + 1 < reader.end){
-				u8 nextc = *(reader.now + 1);
-				if(nextc != '\r' && nextc != '\n') break;
-				reader.now ++;
-			}
-		}
-		reader.now ++;
-		if(reader.now == reader.end) return;
-		data.push_back({});
-		reader.l = reader.now;
+		while(reader.now < reader.end && (*reader.now == '\r' || *reader.now == '\n')) reader.now ++;
 	}
 
 	// カンマを処理
 	inline void read_comma(){
 		reader.now ++;
-		reader.l = reader.now;
+	}
+
+
+	struct WritePiece{
+		const char* p;
+		size_t n;
+		size_t dquote; // 0:囲まない それ以外:1 + 中の"の数
+	};
+	struct WriteBlock{
+		std::vector<WritePiece> pieces;
+		std::vector<size_t> cells; // 各行のフィールド数
+		std::vector<char> arena; // 数値を文字列にしたもの
+		size_t used;
+		std::vector<u8> out;
+	};
+
+	// 書き出し先 gzip なら渡されたブロックごとに deflate する
+	class WriteSink{
+	public:
+		// reserve: 無圧縮で書いたときの大きさの見積もり
+		WriteSink(const std::string & path, const WriteOptions & w_op, const size_t reserve) : out(path, w_op.gzip ? 0 : reserve, w_op.atomic), gzip(w_op.gzip){
+			if(!gzip) return;
+			z.zalloc = Z_NULL; z.zfree = Z_NULL; z.opaque = Z_NULL;
+			const int level = std::clamp(static_cast<int>(w_op.gzip_level), 0, 9);
+			// 初期化できなければ書き出し自体を失敗させる (無圧縮で書いて .gz の名前を付けることはしない)
+			if(deflateInit2(&z, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK){
+				gzip = false;
+				out.abort();
+				return;
+			}
+			buf.resize(1 << 16);
+		}
+		// ブロックを順に書く 無圧縮ならまとめて一度の writev で済ませる
+		void put(const std::vector<WriteBlock> & blocks){
+			if(!gzip){
+				std::vector<std::span<const u8>> spans;
+				for(const WriteBlock & block : blocks) spans.emplace_back(block.out);
+				out.write(spans);
+				return;
+			}
+			// avail_in は 32bit なので、UINT_MAX バイトずつ渡す
+			for(const WriteBlock & block : blocks){
+				const u8* p = block.out.data();
+				size_t rest = block.out.size();
+				while(rest > 0){
+					z.next_in = const_cast<u8*>(p);
+					z.avail_in = std::min<size_t>(rest, UINT_MAX);
+					p += z.avail_in;
+					rest -= z.avail_in;
+					deflate_all(Z_NO_FLUSH);
+				}
+			}
+		}
+		bool close(){
+			if(gzip){
+				z.next_in = Z_NULL;
+				z.avail_in = 0;
+				deflate_all(Z_FINISH);
+				deflateEnd(&z);
+				gzip = false;
+			}
+			return out.close();
+		}
+	private:
+		FileWriter out;
+		bool gzip;
+		z_stream z;
+		std::vector<u8> buf;
+		void deflate_all(const int flush){
+			int ret;
+			do{
+				z.next_out = buf.data();
+				z.avail_out = buf.size();
+				ret = deflate(&z, flush);
+				if(ret != Z_OK && ret != Z_BUF_ERROR && ret != Z_STREAM_END) break;
+				out.write(std::span<const u8>(buf.data(), buf.size() - z.avail_out));
+			} while(z.avail_out == 0 || (flush == Z_FINISH && ret == Z_OK));
+			// 圧縮に失敗したか、終端まで書けなかったら close() を失敗させる
+			if((ret != Z_OK && ret != Z_BUF_ERROR && ret != Z_STREAM_END) || (flush == Z_FINISH && ret != Z_STREAM_END)) out.abort();
+		}
+	};
+
+	// ヘッダ行を含めた書き出す行数
+	size_t write_rows() const{
+		if(cols.empty()) return data.size();
+		return rows + write_has_name();
+	}
+	bool write_has_name() const{
+		for(const Column & col : cols)
+			if(!col.name.empty()) return true;
+		return false;
+	}
+	size_t write_cells(const size_t h) const{
+		return cols.empty() ? data[h].size() : cols.size();
+	}
+
+	// , " CR LF のいずれかを含むか
+	static bool needs_dquote(const char* p, size_t n){
+#ifdef __SSE2__
+		const __m128i comma = _mm_set1_epi8(','), dquote = _mm_set1_epi8('"'),
+			cr = _mm_set1_epi8('\r'), lf = _mm_set1_epi8('\n');
+		for(; n >= 16; p += 16, n -= 16){
+			const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+			const __m128i m = _mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(x, comma), _mm_cmpeq_epi8(x, dquote)),
+				_mm_or_si128(_mm_cmpeq_epi8(x, cr), _mm_cmpeq_epi8(x, lf))
+			);
+			if(_mm_movemask_epi8(m) != 0) return true;
+		}
+#endif
+		for(; n > 0; ++p, --n){
+			const char c = *p;
+			if(c == ',' || c == '"' || c == '\r' || c == '\n') return true;
+		}
+		return false;
+	}
+
+	static void write_piece(WriteBlock & block, const char* p, const size_t n, const bool all_dquote){
+		size_t dquote = 0;
+		if(all_dquote || needs_dquote(p, n)) dquote = 1 + std::count(p, p + n, '"');
+		block.pieces.push_back({p, n, dquote});
+	}
+
+	// 行 h のフィールドを並べる
+	void write_row_pieces(size_t h, WriteBlock & block, const bool all_dquote) const{
+		if(cols.empty()){
+			for(const std::string & el : data[h]) write_piece(block, el.data(), el.size(), all_dquote);
+			return;
+		}
+		if(write_has_name()){
+			if(h == 0){
+				for(const Column & col : cols) write_piece(block, col.name.data(), col.name.size(), all_dquote);
+				return;
+			}
+			h --;
+		}
+		for(const Column & col : cols){
+			char* const buf = block.arena.data() + block.used;
+			char* last = buf;
+			switch(col.type){
+				case Type::I64: last = std::to_chars(buf, buf + 32, col.i64s[h]).ptr; break;
+				case Type::U64: last = std::to_chars(buf, buf + 32, col.u64s[h]).ptr; break;
+				case Type::F64: last = std::to_chars(buf, buf + 32, col.f64s[h]).ptr; break;
+				case Type::BOOL:
+					if(col.bools[h]) write_piece(block, "true", 4, all_dquote);
+					else write_piece(block, "false", 5, all_dquote);
+					continue;
+				case Type::DICT:{
+					const std::string_view v = col.at(h);
+					write_piece(block, v.data(), v.size(), all_dquote);
+					continue;
+				}
+				default:
+					write_piece(block, col.strings[h].data(), col.strings[h].size(), all_dquote);
+					continue;
+			}
+			block.used += last - buf;
+			write_piece(block, buf, last - buf, all_dquote);
+		}
+	}
+
+	// [l, r) 行目を block.out に整形する
+	// 先に全フィールドの大きさを求めて出力を確保し、後から埋める
+	void write_block(const size_t l, const size_t r, const size_t total, const WriteOptions & w_op, WriteBlock & block) const{
+		block.pieces.clear();
+		block.cells.clear();
+		block.arena.resize(std::max(block.arena.size(), cols.size() * (r - l) * 32));
+		block.used = 0;
+		size_t size = 0;
+		for(size_t h = l; h < r; ++h){
+			const size_t first = block.pieces.size();
+			write_row_pieces(h, block, w_op.all_dquote);
+			const size_t cells = block.pieces.size() - first;
+			for(size_t i = first; i < block.pieces.size(); ++i){
+				const WritePiece & piece = block.pieces[i];
+				size += piece.n + (piece.dquote > 0 ? piece.dquote + 1 : 0);
+			}
+			if(cells > 0) size += cells - 1;
+			if(cells < w_op.min_width) size += w_op.min_width - cells;
+			if(h + 1 < total) size += 2;
+			block.cells.push_back(cells);
+		}
+		block.out.resize(size);
+		if(size == 0) return; // 空のとき data() は nullptr のことがあり memcpy に渡せない
+		u8* ptr = block.out.data();
+		const WritePiece* piece = block.pieces.data();
+		for(size_t h = l; h < r; ++h){
+			const size_t cells = block.cells[h - l];
+			for(size_t i = 0; i < cells; ++i, ++piece){
+				if(i > 0) *ptr++ = ',';
+				if(piece->dquote == 0){
+					std::memcpy(ptr, piece->p, piece->n);
+					ptr += piece->n;
+					continue;
+				}
+				*ptr++ = '"';
+				const char *p = piece->p, *last = p + piece->n;
+				while(p != last){
+					const char* q = static_cast<const char*>(std::memchr(p, '"', last - p));
+					const bool found = q != nullptr;
+					q = found ? q + 1 : last;
+					std::memcpy(ptr, p, q - p);
+					ptr += q - p;
+					if(found) *ptr++ = '"';
+					p = q;
+				}
+				*ptr++ = '"';
+			}
+			if(cells < w_op.min_width) ptr = std::fill_n(ptr, w_op.min_width - cells, ',');
+			if(h + 1 < total){
+				*ptr++ = '\r';
+				*ptr++ = '\n';
+			}
+		}
 	}
 
 };
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef FENWICK_TEMPLATE_HPP
+#define FENWICK_TEMPLATE_HPP
+
+#include <vector>
+#include <bit>
+
+#include "int.hpp"
+
+// 一点加算と区間和だけなら SegTree の半分の大きさで済む
+// 内部は1始まり dt[i] は (i - (i & -i), i] の和
+template <typename T>
+class Fenwick{
+	private:
+	size_t n;
+	std::vector<T> dt;
+
+	Fenwick() = delete;
+
+
+	public:
+	Fenwick(const size_t _n) : n(_n), dt(_n + 1, T(0)) {}
+	Fenwick(const std::vector<T> & vec) : n(vec.size()){
+		dt.reserve(n + 1);
+		dt.push_back(T(0));
+		dt.insert(dt.end(), vec.begin(), vec.end());
+		for(size_t i = 1; i <= n; ++i){
+			const size_t parent = i + (i & -i);
+			if(parent <= n) dt[parent] += dt[i];
+		}
+	}
+
+	size_t size() const{
+		return n;
+	}
+
+	void add(size_t dst, const T value){
+		for(++dst; dst <= n; dst += dst & -dst) dt[dst] += value;
+	}
+
+	// [0, r)
+	T prefix(size_t r) const{
+		T res = T(0);
+		for(; r > 0; r &= r - 1) res += dt[r];
+		return res;
+	}
+
+	// [l, r]
+	T range0(const size_t l, const size_t r) const{
+		return prefix(r + 1) - prefix(l);
+	}
+
+	// [l, r)
+	T range1(const size_t l, const size_t r) const{
+		return prefix(r) - prefix(l);
+	}
+
+	// prefix(i + 1) >= val となる最初の i (無ければ size()) 値は全て非負であること
+	size_t lower_find(T val) const{
+		if(val <= T(0)) return 0;
+		size_t pos = 0;
+		for(size_t step = std::bit_floor(n); step > 0; step >>= 1){
+			if(pos + step <= n && dt[pos + step] < val){
+				pos += step;
+				val -= dt[pos];
+			}
+		}
+		return pos;
+	}
+};
+
+#endif
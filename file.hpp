@@ -4,9 +4,49 @@
 #include <fstream>
 #include <filesystem>
 #include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <mutex>
+#include <memory>
+#include <span>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+#if __has_include(<sys/mman.h>)
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#define FILE_HAS_MMAP 1
+#else
+	#define FILE_HAS_MMAP 0
+#endif
+
+// FileWriter で writev, ftruncate などを使う
+#if __has_include(<sys/uio.h>)
+	#include <sys/uio.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <climits>
+	#define FILE_HAS_POSIX_IO 1
+#else
+	#define FILE_HAS_POSIX_IO 0
+#endif
+
+#if defined(__AVX2__) || defined(__SSSE3__)
+	#include <immintrin.h>
+#endif
+
 #include "int.hpp"
 
 #if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
@@ -26,13 +66,235 @@ inline std::vector<u8> readFile(const std::string & path){
 	return result;
 }
 
+// 複数のバッファをまとめて書き出す (POSIX では writev)
+// reserve: 書き出す予定の大きさ 分かっていれば先に領域を確保する
+// atomic: 一時ファイルに書いてから close() で置き換える (途中で失敗しても元のファイルは残る)
+class FileWriter{
+public:
+	FileWriter(const std::string & path_, const size_t reserve = 0, const bool atomic_ = false) : path(path_), atomic(atomic_){
+		static std::atomic<u32> counter = 0;
+		target = atomic ? path + ".tmp." + std::to_string(counter++) : path;
+#if FILE_HAS_POSIX_IO
+		if(atomic) target += "." + std::to_string(::getpid());
+		fd = ::open(target.c_str(), O_WRONLY | O_CREAT | O_TRUNC | (atomic ? O_EXCL : 0), 0666);
+		good = fd >= 0;
+	#ifdef __linux__
+		if(good && reserve > 0) ::fallocate(fd, 0, 0, reserve);
+	#endif
+#else
+		(void)reserve;
+		out.open(target, std::ios::binary);
+		good = out.is_open();
+#endif
+	}
+	~FileWriter(){
+		if(!closed) close();
+	}
+
+	FileWriter(const FileWriter &) = delete;
+	FileWriter & operator=(const FileWriter &) = delete;
+
+	bool ok() const{ return good; }
+
+	// 以降の書き込みをやめ、close() を失敗させる (atomic なら一時ファイルを消し、元のファイルは残る)
+	void abort(){
+		good = false;
+	}
+
+	bool write(const std::span<const std::span<const u8>> buffers){
+		if(!good) return false;
+#if FILE_HAS_POSIX_IO
+		std::vector<iovec> iov;
+		iov.reserve(buffers.size());
+		for(const auto & b : buffers)
+			if(!b.empty()) iov.push_back({const_cast<u8*>(b.data()), b.size()});
+		size_t i = 0;
+		while(i < iov.size()){
+			const int cnt = std::min<size_t>(iov.size() - i, IOV_MAX);
+			const ssize_t n = ::writev(fd, iov.data() + i, cnt);
+			if(n < 0){
+				if(errno == EINTR) continue;
+				good = false;
+				return false;
+			}
+			written += n;
+			// 書ききれなかった分を進める
+			size_t rest = n;
+			while(i < iov.size() && rest >= iov[i].iov_len) rest -= iov[i++].iov_len;
+			if(rest > 0){
+				iov[i].iov_base = static_cast<u8*>(iov[i].iov_base) + rest;
+				iov[i].iov_len -= rest;
+			}
+		}
+#else
+		for(const auto & b : buffers){
+			out.write(reinterpret_cast<const char*>(b.data()), b.size());
+			written += b.size();
+		}
+		good = static_cast<bool>(out);
+#endif
+		return good;
+	}
+	bool write(const std::span<const u8> buffer){
+		return write(std::span<const std::span<const u8>>(&buffer, 1));
+	}
+
+	bool close(){
+		if(closed) return good;
+		closed = true;
+#if FILE_HAS_POSIX_IO
+		if(fd >= 0){
+			// 確保しすぎた分を切り詰める
+			if(good && ::ftruncate(fd, written) != 0) good = false;
+			// 置き換える前に元のファイルの許可属性を引き継ぐ
+			struct stat st;
+			if(good && atomic && ::stat(path.c_str(), &st) == 0 && ::fchmod(fd, st.st_mode & 07777) != 0) good = false;
+			if(::close(fd) != 0) good = false;
+		}
+#else
+		out.close();
+		good = good && static_cast<bool>(out);
+#endif
+		if(atomic){
+			std::error_code ec;
+			if(good) std::filesystem::rename(target, path, ec);
+			if(!good || ec){
+				std::filesystem::remove(target, ec);
+				good = false;
+			}
+		}
+		return good;
+	}
+
+private:
+	std::string path, target;
+	bool atomic;
+	bool good = false;
+	bool closed = false;
+	size_t written = 0;
+#if FILE_HAS_POSIX_IO
+	int fd = -1;
+#else
+	std::ofstream out;
+#endif
+};
+
+inline bool writeFileV(const std::string & path, const std::span<const std::span<const u8>> buffers, const bool atomic = false){
+	size_t total = 0;
+	for(const auto & b : buffers) total += b.size();
+	FileWriter out(path, total, atomic);
+	out.write(buffers);
+	return out.close();
+}
+inline bool writeFileV(const std::string & path, const std::initializer_list<std::span<const u8>> buffers, const bool atomic = false){
+	return writeFileV(path, std::span<const std::span<const u8>>(buffers.begin(), buffers.size()), atomic);
+}
+
 inline void writeFile(const std::string & path, const std::vector<u8> & stream){
-	std::ofstream out(path, std::ios::binary);
-	out.write(reinterpret_cast<const char*>(stream.data()), stream.size());
-	out.close();
+	writeFileV(path, {std::span<const u8>(stream)});
 	return;
 }
 
+// 読み取り専用でファイルをメモリに割り当てる
+// mmap が使えない環境では readFile で読み込んだものを持つ
+class MappedFile{
+public:
+	enum class Access{
+		NORMAL,
+		SEQUENTIAL, // 先頭から順に読む (先読みを増やす)
+		RANDOM // ランダムに読む (先読みしない)
+	};
+
+	MappedFile() = default;
+	MappedFile(const std::string & path, const Access access = Access::SEQUENTIAL){ open(path, access); }
+	~MappedFile(){ close(); }
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile & operator=(const MappedFile &) = delete;
+	MappedFile(MappedFile && other) noexcept{ *this = std::move(other); }
+	MappedFile & operator=(MappedFile && other) noexcept{
+		if(this != &other){
+			close();
+			ptr = std::exchange(other.ptr, nullptr);
+			sz = std::exchange(other.sz, 0);
+			opened = std::exchange(other.opened, false);
+			mapped = std::exchange(other.mapped, false);
+			buffer = std::move(other.buffer);
+		}
+		return *this;
+	}
+
+	bool open(const std::string & path, const Access access = Access::SEQUENTIAL){
+		close();
+#if FILE_HAS_MMAP
+		const int fd = ::open(path.c_str(), O_RDONLY);
+		if(fd < 0) return false;
+		struct stat st;
+		if(::fstat(fd, &st) != 0){
+			::close(fd);
+			return false;
+		}
+		sz = st.st_size;
+		opened = true;
+		if(sz > 0){
+			void* p = ::mmap(nullptr, sz, PROT_READ, MAP_PRIVATE, fd, 0);
+			if(p != MAP_FAILED){
+				ptr = static_cast<const u8*>(p);
+				mapped = true;
+				advise(access);
+			}
+		}
+		::close(fd);
+		if(sz == 0 || mapped) return true;
+		close();
+#endif
+		std::error_code ec;
+		if(!std::filesystem::is_regular_file(path, ec)) return false;
+		buffer = readFile(path);
+		ptr = buffer.data();
+		sz = buffer.size();
+		opened = true;
+		return true;
+	}
+
+	void close(){
+#if FILE_HAS_MMAP
+		if(mapped) ::munmap(const_cast<u8*>(ptr), sz);
+#endif
+		ptr = nullptr;
+		sz = 0;
+		opened = false;
+		mapped = false;
+		buffer = {};
+	}
+
+	// 以降のアクセス方法をカーネルに伝える
+	void advise([[maybe_unused]] const Access access){
+#if FILE_HAS_MMAP
+		if(!mapped) return;
+		int advice = MADV_NORMAL;
+		if(access == Access::SEQUENTIAL) advice = MADV_SEQUENTIAL;
+		if(access == Access::RANDOM) advice = MADV_RANDOM;
+		::madvise(const_cast<u8*>(ptr), sz, advice);
+#endif
+	}
+
+	bool is_open() const{ return opened; }
+	const u8* data() const{ return ptr; }
+	size_t size() const{ return sz; }
+	const u8* begin() const{ return ptr; }
+	const u8* end() const{ return ptr + sz; }
+	std::span<const u8> span() const{ return {ptr, sz}; }
+	operator std::span<const u8>() const{ return span(); }
+
+private:
+	const u8* ptr = nullptr;
+	size_t sz = 0;
+	bool opened = false;
+	bool mapped = false;
+	std::vector<u8> buffer;
+};
+
 
 inline std::vector<std::string> getFileList(const std::string & folder_path){
 	std::vector<std::string> result;
@@ -45,11 +307,149 @@ inline std::vector<std::string> getFileList(const std::string & folder_path){
 	return result;
 }
 
+struct FileEntry{
+	std::string path;
+	size_t size;
+};
+
+// folder_path 以下の通常ファイルを探す
+// extensions: 拡張子 (".csv" など) 空なら全て
+inline std::vector<FileEntry> findFiles(
+	const std::string & folder_path,
+	const std::vector<std::string> & extensions = {},
+	const bool recursive = true
+){
+	std::vector<FileEntry> result;
+	auto push = [&](const std::filesystem::directory_entry & f){
+		std::error_code ec;
+		if(!f.is_regular_file(ec)) return;
+		if(!extensions.empty()){
+			const std::string ext = f.path().extension().string();
+			if(std::find(extensions.begin(), extensions.end(), ext) == extensions.end()) return;
+		}
+		const size_t size = f.file_size(ec);
+		result.push_back({f.path().string(), ec ? 0 : size});
+	};
+	std::error_code ec;
+	if(recursive){
+		auto itr = std::filesystem::recursive_directory_iterator(folder_path, std::filesystem::directory_options::skip_permission_denied, ec);
+		for(; !ec && itr != std::filesystem::recursive_directory_iterator(); itr.increment(ec)) push(*itr);
+	}
+	else{
+		auto itr = std::filesystem::directory_iterator(folder_path, ec);
+		for(; !ec && itr != std::filesystem::directory_iterator(); itr.increment(ec)) push(*itr);
+	}
+	std::sort(result.begin(), result.end(), [](const FileEntry & a, const FileEntry & b){ return a.path < b.path; });
+	return result;
+}
+
+// ファイルの読み込みと decode をワーカースレッドで先に進めておき、next() で順番通りに受け取る
+// 先行するのは最大 ahead 件まで
+template<typename T = std::vector<u8>>
+class FileLoader{
+public:
+	using Decoder = std::function<T(const FileEntry &, std::vector<u8> &&)>;
+
+	FileLoader(
+		std::vector<FileEntry> files_,
+		Decoder decode_ = [](const FileEntry &, std::vector<u8> && bytes){ return T(std::move(bytes)); },
+		const u32 threads = std::max(2u, std::thread::hardware_concurrency()),
+		const size_t ahead_ = 16
+	) : files(std::move(files_)), decode(std::move(decode_)), ahead(std::max<size_t>(ahead_, 1)), slots(ahead){
+		for(u32 t = 0; t < std::max<u32>(threads, 1); ++t) workers.emplace_back([this]{ work(); });
+	}
+	~FileLoader(){
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			stopped = true;
+		}
+		cv_worker.notify_all();
+		for(auto & th : workers) th.join();
+	}
+
+	FileLoader(const FileLoader &) = delete;
+	FileLoader & operator=(const FileLoader &) = delete;
+
+	// 次のファイルを受け取る 全て受け取り終えていれば false
+	bool next(FileEntry & entry, T & value){
+		std::unique_lock<std::mutex> lock(mtx);
+		if(consumed == files.size()) return false;
+		Slot & slot = slots[consumed % ahead];
+		cv_consumer.wait(lock, [&]{ return slot.ready; });
+		entry = files[consumed];
+		value = std::move(slot.value);
+		slot.ready = false;
+		consumed ++;
+		lock.unlock();
+		cv_worker.notify_all();
+		return true;
+	}
+
+	size_t size() const{ return files.size(); }
+
+private:
+	struct Slot{
+		T value;
+		bool ready = false;
+	};
+
+	const std::vector<FileEntry> files;
+	const Decoder decode;
+	const size_t ahead;
+	std::vector<Slot> slots;
+	std::vector<std::thread> workers;
+	std::mutex mtx;
+	std::condition_variable cv_worker, cv_consumer;
+	size_t taken = 0, consumed = 0;
+	bool stopped = false;
+
+	void work(){
+		while(true){
+			size_t i;
+			{
+				std::unique_lock<std::mutex> lock(mtx);
+				cv_worker.wait(lock, [&]{ return stopped || taken == files.size() || taken < consumed + ahead; });
+				if(stopped || taken == files.size()) return;
+				i = taken ++;
+			}
+			T value = decode(files[i], readFile(files[i].path));
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				slots[i % ahead].value = std::move(value);
+				slots[i % ahead].ready = true;
+			}
+			cv_consumer.notify_one();
+		}
+	}
+};
+
+template<typename T>
+inline T byteswap(const T value){
+	static_assert(sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8);
+	if constexpr (sizeof(T) == 1) return value;
+	else{
+		using U = std::conditional_t<sizeof(T) == 2, u16, std::conditional_t<sizeof(T) == 4, u32, u64>>;
+		U u;
+		std::memcpy(&u, &value, sizeof(T));
+		if constexpr (sizeof(T) == 2) u = __builtin_bswap16(u);
+		else if constexpr (sizeof(T) == 4) u = __builtin_bswap32(u);
+		else u = __builtin_bswap64(u);
+		T res;
+		std::memcpy(&res, &u, sizeof(T));
+		return res;
+	}
+}
+
+// 連続したメモリ上のイテレータなら memcpy と bswap 一回で済ませる
 template<typename T, typename II>
 inline T readValue(II & itr, const bool is_little_endian){
 	T res;
 	II last = itr + sizeof(T);
-	if(is_little_endian == SYSTEM_LITTLE_ENDIAN){
+	if constexpr (std::contiguous_iterator<II>){
+		std::memcpy(&res, std::to_address(itr), sizeof(T));
+		if(is_little_endian != SYSTEM_LITTLE_ENDIAN) res = byteswap(res);
+	}
+	else if(is_little_endian == SYSTEM_LITTLE_ENDIAN){
 		std::copy(itr, last, reinterpret_cast<u8*>(&res));
 	}
 	else{
@@ -60,33 +460,35 @@ inline T readValue(II & itr, const bool is_little_endian){
 }
 template<typename T, typename II>
 inline T readBE(II & itr){
-	T res;
-	II last = itr + sizeof(T);
-	if constexpr (SYSTEM_LITTLE_ENDIAN){
-		std::reverse_copy(itr, last, reinterpret_cast<u8*>(&res));
+	if constexpr (std::contiguous_iterator<II>){
+		T res;
+		std::memcpy(&res, std::to_address(itr), sizeof(T));
+		itr += sizeof(T);
+		if constexpr (SYSTEM_LITTLE_ENDIAN) res = byteswap(res);
+		return res;
 	}
-	else{
-		std::copy(itr, last, reinterpret_cast<u8*>(&res));
-	}
-	itr = last;
-	return res;
+	else return readValue<T>(itr, false);
 }
 template<typename T, typename II>
 inline T readLE(II & itr){
-	T res;
-	II last = itr + sizeof(T);
-	if constexpr (SYSTEM_LITTLE_ENDIAN){
-		std::copy(itr, last, reinterpret_cast<u8*>(&res));
+	if constexpr (std::contiguous_iterator<II>){
+		T res;
+		std::memcpy(&res, std::to_address(itr), sizeof(T));
+		itr += sizeof(T);
+		if constexpr (!SYSTEM_LITTLE_ENDIAN) res = byteswap(res);
+		return res;
 	}
-	else{
-		std::reverse_copy(itr, last, reinterpret_cast<u8*>(&res));
-	}
-	itr = last;
-	return res;
+	else return readValue<T>(itr, true);
 }
 
 template<typename T, typename OI>
-inline void writeValue(OI & itr, const T value, const bool is_little_endian){
+inline void writeValue(OI & itr, T value, const bool is_little_endian){
+	if constexpr (std::contiguous_iterator<OI>){
+		if(is_little_endian != SYSTEM_LITTLE_ENDIAN) value = byteswap(value);
+		std::memcpy(std::to_address(itr), &value, sizeof(T));
+		itr += sizeof(T);
+		return;
+	}
 	const u8* src = reinterpret_cast<const u8*>(&value);
 	if(is_little_endian == SYSTEM_LITTLE_ENDIAN){
 		itr = std::copy(src, src + sizeof(T), itr);
@@ -97,25 +499,178 @@ inline void writeValue(OI & itr, const T value, const bool is_little_endian){
 }
 template<typename T, typename OI>
 inline void writeBE(OI & itr, const T value){
-	const u8* src = reinterpret_cast<const u8*>(&value);
-	if constexpr (SYSTEM_LITTLE_ENDIAN){
-		itr = std::reverse_copy(src, src + sizeof(T), itr);
-	}
-	else{
-		itr = std::copy(src, src + sizeof(T), itr);
-	}
+	writeValue<T>(itr, value, false);
 }
 template<typename T, typename OI>
 inline void writeLE(OI & itr, const T value){
-	const u8* src = reinterpret_cast<const u8*>(&value);
-	if constexpr (SYSTEM_LITTLE_ENDIAN){
-		itr = std::copy(src, src + sizeof(T), itr);
-	}
+	writeValue<T>(itr, value, true);
+}
+
+// 配列の各要素のバイト順を反転する
+template<typename T>
+inline void byteswapArray(T* data, size_t count){
+	static_assert(sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8);
+	if constexpr (sizeof(T) == 1) return;
 	else{
-		itr = std::reverse_copy(src, src + sizeof(T), itr);
+#if defined(__AVX2__) || defined(__SSSE3__)
+		alignas(32) u8 mask[32];
+		for(u8 i = 0; i < 32; ++i) mask[i] = (i / sizeof(T) + 1) * sizeof(T) - 1 - i % sizeof(T);
+		u8* p = reinterpret_cast<u8*>(data);
+		size_t n = count * sizeof(T);
+	#ifdef __AVX2__
+		const __m256i m32 = _mm256_load_si256(reinterpret_cast<const __m256i*>(mask));
+		for(; n >= 32; p += 32, n -= 32){
+			__m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(p), _mm256_shuffle_epi8(x, m32));
+		}
+	#endif
+		const __m128i m16 = _mm_load_si128(reinterpret_cast<const __m128i*>(mask));
+		for(; n >= 16; p += 16, n -= 16){
+			__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm_shuffle_epi8(x, m16));
+		}
+		data = reinterpret_cast<T*>(p);
+		count = n / sizeof(T);
+#endif
+		for(size_t i = 0; i < count; ++i) data[i] = byteswap(data[i]);
 	}
 }
 
+// count 個の値をまとめて読み書きする
+template<typename T>
+inline std::vector<T> readBE(const std::span<const u8> src, const size_t count){
+	std::vector<T> res(std::min(count, src.size() / sizeof(T)));
+	if(!res.empty()) std::memcpy(res.data(), src.data(), res.size() * sizeof(T));
+	if constexpr (SYSTEM_LITTLE_ENDIAN) byteswapArray(res.data(), res.size());
+	return res;
+}
+template<typename T>
+inline std::vector<T> readLE(const std::span<const u8> src, const size_t count){
+	std::vector<T> res(std::min(count, src.size() / sizeof(T)));
+	if(!res.empty()) std::memcpy(res.data(), src.data(), res.size() * sizeof(T));
+	if constexpr (!SYSTEM_LITTLE_ENDIAN) byteswapArray(res.data(), res.size());
+	return res;
+}
+// 書き込んだバイト数を返す
+template<typename T>
+inline size_t writeBE(const std::span<u8> dst, const std::span<const T> values){
+	const size_t count = std::min(values.size(), dst.size() / sizeof(T));
+	if(count == 0) return 0;
+	std::memcpy(dst.data(), values.data(), count * sizeof(T));
+	if constexpr (SYSTEM_LITTLE_ENDIAN) byteswapArray(reinterpret_cast<T*>(dst.data()), count);
+	return count * sizeof(T);
+}
+template<typename T>
+inline size_t writeLE(const std::span<u8> dst, const std::span<const T> values){
+	const size_t count = std::min(values.size(), dst.size() / sizeof(T));
+	if(count == 0) return 0;
+	std::memcpy(dst.data(), values.data(), count * sizeof(T));
+	if constexpr (!SYSTEM_LITTLE_ENDIAN) byteswapArray(reinterpret_cast<T*>(dst.data()), count);
+	return count * sizeof(T);
+}
+
+
+// 範囲を確かめながら読み進める
+// 足りなければ 0 を返し、以降 ok() は false になる
+// 先に need(n) で n バイトあることを確かめれば、その分は getBE/getLE で確かめずに読める
+class ByteReader{
+public:
+	ByteReader(const std::span<const u8> src) : ptr(src.data()), last(src.data() + src.size()), first(src.data()) {}
+
+	bool ok() const{ return good; }
+	size_t position() const{ return ptr - first; }
+	size_t remaining() const{ return last - ptr; }
+	const u8* data() const{ return ptr; }
+
+	bool need(const size_t n){
+		if(remaining() >= n) return true;
+		good = false;
+		return false;
+	}
+
+	template<typename T> T getBE(){ return ::readBE<T>(ptr); }
+	template<typename T> T getLE(){ return ::readLE<T>(ptr); }
+
+	template<typename T> T readBE(){ return need(sizeof(T)) ? getBE<T>() : T(0); }
+	template<typename T> T readLE(){ return need(sizeof(T)) ? getLE<T>() : T(0); }
+	u8 read(){ return need(1) ? *ptr++ : 0; }
+
+	template<typename T> std::vector<T> readBE(const size_t count){
+		if(!need(count * sizeof(T))) return {};
+		auto res = ::readBE<T>(std::span<const u8>(ptr, count * sizeof(T)), count);
+		ptr += count * sizeof(T);
+		return res;
+	}
+	template<typename T> std::vector<T> readLE(const size_t count){
+		if(!need(count * sizeof(T))) return {};
+		auto res = ::readLE<T>(std::span<const u8>(ptr, count * sizeof(T)), count);
+		ptr += count * sizeof(T);
+		return res;
+	}
+
+	std::span<const u8> bytes(const size_t n){
+		if(!need(n)) return {};
+		const u8* p = ptr;
+		ptr += n;
+		return {p, n};
+	}
+	std::string string(const size_t n){
+		const auto b = bytes(n);
+		return std::string(b.begin(), b.end());
+	}
+	void skip(const size_t n){
+		if(need(n)) ptr += n;
+	}
+
+private:
+	const u8 *ptr, *last, *first;
+	bool good = true;
+};
+
+// 範囲を確かめながら書き進める 溢れる書き込みは捨てて ok() を false にする
+class ByteWriter{
+public:
+	ByteWriter(const std::span<u8> dst) : ptr(dst.data()), last(dst.data() + dst.size()), first(dst.data()) {}
+
+	bool ok() const{ return good; }
+	size_t position() const{ return ptr - first; }
+	size_t remaining() const{ return last - ptr; }
+	u8* data() const{ return ptr; }
+
+	bool need(const size_t n){
+		if(remaining() >= n) return true;
+		good = false;
+		return false;
+	}
+
+	template<typename T> void putBE(const T value){ ::writeBE<T>(ptr, value); }
+	template<typename T> void putLE(const T value){ ::writeLE<T>(ptr, value); }
+
+	template<typename T> void writeBE(const T value){ if(need(sizeof(T))) putBE<T>(value); }
+	template<typename T> void writeLE(const T value){ if(need(sizeof(T))) putLE<T>(value); }
+	void write(const u8 value){ if(need(1)) *ptr++ = value; }
+
+	template<typename T> void writeBE(const std::span<const T> values){
+		if(need(values.size() * sizeof(T))) ptr += ::writeBE<T>(std::span<u8>(ptr, values.size() * sizeof(T)), values);
+	}
+	template<typename T> void writeLE(const std::span<const T> values){
+		if(need(values.size() * sizeof(T))) ptr += ::writeLE<T>(std::span<u8>(ptr, values.size() * sizeof(T)), values);
+	}
+
+	void bytes(const std::span<const u8> src){
+		if(!need(src.size())) return;
+		if(!src.empty()) std::memcpy(ptr, src.data(), src.size());
+		ptr += src.size();
+	}
+	void string(const std::string_view str){
+		bytes(std::span<const u8>(reinterpret_cast<const u8*>(str.data()), str.size()));
+	}
+
+private:
+	u8 *ptr, *last, *first;
+	bool good = true;
+};
+
 template<typename II>
 inline std::string readString(II & itr, const size_t size){
 	std::string res(itr, itr + size);
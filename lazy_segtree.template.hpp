@@ -0,0 +1,237 @@
+#ifndef LAZY_SEGTREE_TEMPLATE_HPP
+#define LAZY_SEGTREE_TEMPLATE_HPP
+
+#include <optional>
+
+#include "segtree.template.hpp"
+
+// 作用: 遅延させているタグ f を値 x に施す apply(f, x) を static に持つ型
+template <typename A, typename F, typename T>
+concept ActionOf = requires(const F f, const T x){
+	{ A::apply(f, x) } -> std::convertible_to<T>;
+};
+
+namespace Monoid{
+	// 代入のタグ 後から来た方が勝つ
+	template <typename T>
+	struct Assign{
+		static constexpr std::optional<T> identity(){ return std::nullopt; }
+		static constexpr std::optional<T> op(const std::optional<T> f, const std::optional<T> g){ return g ? g : f; }
+	};
+
+	// 区間の長さも持たせた和 区間加算・区間代入と組み合わせる
+	template <typename T>
+	struct SumCount{
+		struct Node{
+			T sum = 0, count = 0;
+		};
+		static constexpr Node identity(){ return Node{}; }
+		static constexpr Node op(const Node a, const Node b){ return Node{a.sum + b.sum, a.count + b.count}; }
+	};
+}
+
+namespace Act{
+	// Min, Max への加算 (タグは Monoid::Sum) 単位元には足さない
+	template <typename M>
+	struct Add{
+		using T = decltype(M::identity());
+		static constexpr T apply(const T f, const T x){ return x == M::identity() ? x : x + f; }
+	};
+
+	// Min, Max への代入 (タグは Monoid::Assign)
+	template <typename T>
+	struct Assign{
+		static constexpr T apply(const std::optional<T> f, const T x){ return f ? *f : x; }
+	};
+
+	// SumCount への加算 (タグは Monoid::Sum)
+	template <typename T>
+	struct AddSum{
+		using Node = typename Monoid::SumCount<T>::Node;
+		static constexpr Node apply(const T f, const Node x){ return Node{x.sum + f * x.count, x.count}; }
+	};
+
+	// SumCount への代入 (タグは Monoid::Assign)
+	template <typename T>
+	struct AssignSum{
+		using Node = typename Monoid::SumCount<T>::Node;
+		static constexpr Node apply(const std::optional<T> f, const Node x){ return f ? Node{*f * x.count, x.count} : x; }
+	};
+}
+
+// M: 値のモノイド F, L: タグとその合成 (L::op(f, g) は f の後に g) A: タグの値への作用
+// 例: 区間加算・区間最小 LazySegTree<i64, Monoid::Min<i64>, i64, Monoid::Sum<i64>, Act::Add<Monoid::Min<i64>>>
+template <typename T, MonoidOf<T> M, typename F, MonoidOf<F> L, ActionOf<F, T> A>
+class LazySegTree{
+	private:
+	static constexpr T e = M::identity();
+	static constexpr F id = L::identity();
+	static inline T op(const T a, const T b){
+		return M::op(a, b);
+	}
+
+	u32 lg;
+	size_t n, sz;
+	std::vector<T> dt;
+	std::vector<F> lz;
+
+	LazySegTree() = delete;
+
+
+	public:
+	LazySegTree(const size_t _n, const T init = e) : LazySegTree(std::vector<T>(_n, init)) {}
+	LazySegTree(const std::vector<T> & vec){
+		n = vec.size();
+		lg = bit_ceil_exp(n);
+		sz = 1ULL << lg;
+		dt.resize(sz + sz, e);
+		lz.resize(sz, id);
+		std::copy(vec.begin(), vec.end(), dt.begin() + sz);
+		for(size_t dst = sz - 1; dst > 0; --dst) update(dst);
+	}
+
+	size_t size() const{
+		return n;
+	}
+
+	void set(size_t dst, const T value){
+		dst += sz;
+		push_path(dst);
+		dt[dst] = value;
+		for(u32 i = 1; i <= lg; ++i) update(dst >> i);
+	}
+
+	T at(size_t ofs){
+		ofs += sz;
+		push_path(ofs);
+		return dt[ofs];
+	}
+
+	// [l, r]
+	T range0(size_t l, size_t r){
+		return range1(l, r + 1);
+	}
+
+	// [l, r)
+	T range1(size_t l, size_t r){
+		if(l == r) return e;
+		l += sz; r += sz;
+		push_bounds(l, r);
+		T resl = e, resr = e;
+		while(l < r){
+			if((l & 1) == 1) resl = op(resl, dt[l++]);
+			if((r & 1) == 1) resr = op(dt[--r], resr);
+			l >>= 1;
+			r >>= 1;
+		}
+		return op(resl, resr);
+	}
+
+	T all() const{
+		return dt[1];
+	}
+
+	void apply(size_t dst, const F f){
+		dst += sz;
+		push_path(dst);
+		dt[dst] = A::apply(f, dt[dst]);
+		for(u32 i = 1; i <= lg; ++i) update(dst >> i);
+	}
+
+	// [l, r) に f を施す
+	void apply(size_t l, size_t r, const F f){
+		if(l == r) return;
+		l += sz; r += sz;
+		push_bounds(l, r);
+		for(size_t a = l, b = r; a < b; a >>= 1, b >>= 1){
+			if((a & 1) == 1) all_apply(a++, f);
+			if((b & 1) == 1) all_apply(--b, f);
+		}
+		for(u32 i = 1; i <= lg; ++i){
+			if(((l >> i) << i) != l) update(l >> i);
+			if(((r >> i) << i) != r) update((r - 1) >> i);
+		}
+	}
+
+	// pred(range1(l, r)) が true となる最大の r (pred(e) は true であること)
+	template <typename P>
+	size_t max_right(size_t l, P pred){
+		if(l == n) return n;
+		l += sz;
+		push_path(l);
+		T cur = e;
+		do{
+			while((l & 1) == 0) l >>= 1;
+			if(!pred(op(cur, dt[l]))){
+				while(l < sz){
+					push(l);
+					l <<= 1;
+					if(pred(op(cur, dt[l]))) cur = op(cur, dt[l++]);
+				}
+				return l - sz;
+			}
+			cur = op(cur, dt[l++]);
+		}while((l & (l - 1)) != 0);
+		return n;
+	}
+
+	// pred(range1(l, r)) が true となる最小の l (pred(e) は true であること)
+	template <typename P>
+	size_t min_left(size_t r, P pred){
+		if(r == 0) return 0;
+		r += sz;
+		push_path(r - 1);
+		T cur = e;
+		do{
+			r --;
+			while(r > 1 && (r & 1) == 1) r >>= 1;
+			if(!pred(op(dt[r], cur))){
+				while(r < sz){
+					push(r);
+					r = r + r + 1;
+					if(pred(op(dt[r], cur))) cur = op(dt[r--], cur);
+				}
+				return r + 1 - sz;
+			}
+			cur = op(dt[r], cur);
+		}while((r & (r - 1)) != 0);
+		return 0;
+	}
+
+	// SegTree::lower_find と同じく、l からの累積が val 以上になる最初の位置 (無ければ size())
+	size_t lower_find(const T val, size_t l = 0){
+		return max_right(l, [&](const T x){ return x < val; });
+	}
+
+
+	private:
+	void update(const size_t dst){
+		dt[dst] = op(dt[dst + dst], dt[dst + dst + 1]);
+	}
+
+	void all_apply(const size_t dst, const F f){
+		dt[dst] = A::apply(f, dt[dst]);
+		if(dst < sz) lz[dst] = L::op(lz[dst], f);
+	}
+
+	void push(const size_t dst){
+		all_apply(dst + dst, lz[dst]);
+		all_apply(dst + dst + 1, lz[dst]);
+		lz[dst] = id;
+	}
+
+	// 葉 leaf までの祖先のタグを根から順に下ろす
+	void push_path(const size_t leaf){
+		for(u32 i = lg; i >= 1; --i) push(leaf >> i);
+	}
+
+	// [l, r) の端にかかる祖先のタグを下ろす
+	void push_bounds(const size_t l, const size_t r){
+		for(u32 i = lg; i >= 1; --i){
+			if(((l >> i) << i) != l) push(l >> i);
+			if(((r >> i) << i) != r) push((r - 1) >> i);
+		}
+	}
+};
+
+#endif
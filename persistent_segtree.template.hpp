@@ -0,0 +1,155 @@
+#ifndef PERSISTENT_SEGTREE_TEMPLATE_HPP
+#define PERSISTENT_SEGTREE_TEMPLATE_HPP
+
+#include "segtree.template.hpp"
+
+// set のたびに新しい版を作り、古い版もそのまま問い合わせられる SegTree
+// 節点は1本の配列 (arena) に積んでいき、子は u32 の添字で指す
+// 版 0 は全て単位元 (節点 0 を共有するので作るのに時間がかからない)
+template <typename T, MonoidOf<T> M = Monoid::Sum<T>>
+class PersistentSegTree{
+	private:
+	static constexpr T e = M::identity();
+	static inline T op(const T a, const T b){
+		return M::op(a, b);
+	}
+
+	struct Node{
+		T value;
+		u32 left, right;
+	};
+
+	size_t n;
+	// arena[0] は単位元の節点 子も自分自身を指す
+	std::vector<Node> arena;
+	std::vector<u32> roots;
+
+	PersistentSegTree() = delete;
+
+
+	public:
+	// reserve_nodes: 先に確保しておく節点数 (1回の set で増えるのは log2(n) + 1 個程度)
+	PersistentSegTree(const size_t _n, const size_t reserve_nodes = 0) : n(_n){
+		arena.reserve(std::max<size_t>(reserve_nodes, 1));
+		reset();
+	}
+
+	// 全ての版と節点を捨てて版 0 だけに戻す 確保した領域はそのまま使い回す
+	void reset(){
+		arena.clear();
+		arena.push_back(Node{e, 0, 0});
+		roots.assign(1, 0);
+	}
+
+	size_t size() const{
+		return n;
+	}
+
+	size_t versions() const{
+		return roots.size();
+	}
+
+	u32 latest() const{
+		return roots.size() - 1;
+	}
+
+	size_t nodes() const{
+		return arena.size();
+	}
+
+	// vec を並べた新しい版を作って返す
+	u32 build(const std::vector<T> & vec){
+		roots.push_back(n == 0 ? 0 : build(vec, 0, n));
+		return latest();
+	}
+
+	// 版 version の dst を value にした新しい版を作って返す
+	u32 set(const u32 version, const size_t dst, const T value){
+		u32 path[64];
+		bool right[64];
+		u32 depth = 0, cur = roots[version];
+		size_t lo = 0, hi = n;
+		while(hi - lo > 1){
+			const size_t mid = lo + (hi - lo) / 2;
+			path[depth] = cur;
+			right[depth] = dst >= mid;
+			depth ++;
+			if(dst < mid){
+				cur = arena[cur].left;
+				hi = mid;
+			}
+			else{
+				cur = arena[cur].right;
+				lo = mid;
+			}
+		}
+		u32 node = alloc(Node{value, 0, 0});
+		while(depth-- > 0){
+			const Node & old = arena[path[depth]];
+			const Node next = right[depth]
+				? Node{op(arena[old.left].value, arena[node].value), old.left, node}
+				: Node{op(arena[node].value, arena[old.right].value), node, old.right};
+			node = alloc(next);
+		}
+		roots.push_back(node);
+		return latest();
+	}
+
+	u32 set(const size_t dst, const T value){
+		return set(latest(), dst, value);
+	}
+
+	T at(const u32 version, const size_t ofs) const{
+		u32 cur = roots[version];
+		size_t lo = 0, hi = n;
+		while(hi - lo > 1){
+			const size_t mid = lo + (hi - lo) / 2;
+			if(ofs < mid){
+				cur = arena[cur].left;
+				hi = mid;
+			}
+			else{
+				cur = arena[cur].right;
+				lo = mid;
+			}
+		}
+		return arena[cur].value;
+	}
+
+	// [l, r]
+	T range0(const u32 version, const size_t l, const size_t r) const{
+		return range1(version, l, r + 1);
+	}
+
+	// [l, r)
+	T range1(const u32 version, const size_t l, const size_t r) const{
+		if(l >= r) return e;
+		return range(roots[version], 0, n, l, r);
+	}
+
+
+	private:
+	u32 alloc(const Node & node){
+		arena.push_back(node);
+		return arena.size() - 1;
+	}
+
+	u32 build(const std::vector<T> & vec, const size_t lo, const size_t hi){
+		if(hi - lo == 1) return alloc(Node{vec[lo], 0, 0});
+		const size_t mid = lo + (hi - lo) / 2;
+		const u32 left = build(vec, lo, mid);
+		const u32 right = build(vec, mid, hi);
+		return alloc(Node{op(arena[left].value, arena[right].value), left, right});
+	}
+
+	// 節点 cur が受け持つのは [lo, hi)
+	T range(const u32 cur, const size_t lo, const size_t hi, const size_t l, const size_t r) const{
+		if(l <= lo && hi <= r) return arena[cur].value;
+		const size_t mid = lo + (hi - lo) / 2;
+		if(r <= mid) return range(arena[cur].left, lo, mid, l, r);
+		if(mid <= l) return range(arena[cur].right, mid, hi, l, r);
+		return op(range(arena[cur].left, lo, mid, l, r), range(arena[cur].right, mid, hi, l, r));
+	}
+};
+
+#endif
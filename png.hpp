@@ -50,6 +50,7 @@ public:
 	PNG(const std::string & path){ read(path); }
 
 	Err read(const std::string & path);
+	Err read(std::span<const u8> stream);
 	// lelel:圧縮レベル(0~9)
 	void write(const std::string & path, u8 level = 7);
 
@@ -77,8 +78,9 @@ protected:
 	static constexpr u32 IEND_crc = 0xAE'42'60'82;
 
 
-	bool read_IHDR(const u8* & ptr, z_stream & z){
-		if(ptr - PNGstream.data() != 16) return false;
+	// begin: 読んでいるデータの先頭 (位置の確認に使う)
+	bool read_IHDR(const u8* & ptr, const u8* const begin, z_stream & z){
+		if(ptr - begin != 16) return false;
 		u8 Bit_depth = 8;
 		u8 Color_type = 2; // 2:RGB 6:RGBA
 		u8 Compression_method = 0; // 0
@@ -110,8 +112,8 @@ protected:
 		return true;
 	}
 
-	bool read_IDAT(const u8* & ptr, const u32 length, z_stream & z){
-		if(ptr - PNGstream.data() < 37) return false;
+	bool read_IDAT(const u8* & ptr, const u8* const begin, const u32 length, z_stream & z){
+		if(ptr - begin < 37) return false;
 		z.next_in = const_cast<u8*>(ptr);
 		z.avail_in = length;
 		int ret;
@@ -123,8 +125,8 @@ protected:
 		return true;
 	}
 
-	bool read_PLTE(const u8* & ptr, const u32 length){
-		if(ptr - PNGstream.data() < 37) return false;
+	bool read_PLTE(const u8* & ptr, const u8* const begin, const u32 length){
+		if(ptr - begin < 37) return false;
 		if(length > 256 * 3 || length % 3 > 0) return false;
 		u16 pallet_size = length / 3;
 		for(u16 i = 0; i < pallet_size; ++i){
@@ -170,16 +172,17 @@ protected:
 		return;
 	}
 
-	void write_IDAT(u8* & ptr, const std::vector<u8> & deflated_stream){
+	// データ本体は書かずに、その前後だけを書く
+	// データは write で別のバッファのまま data_pos の位置に差し込む
+	void write_IDAT(u8* & ptr, const std::vector<u8> & deflated_stream, size_t & data_pos){
 		size_t deflated_size = deflated_stream.size();
 		writeValue<u32>(ptr, deflated_size, false);
 		*ptr++ = 'I';
 		*ptr++ = 'D';
 		*ptr++ = 'A';
 		*ptr++ = 'T';
-		std::copy(deflated_stream.begin(), deflated_stream.end(), ptr);
-		u32 crc = crc32_z(IDAT_crc, ptr, deflated_size);
-		ptr += deflated_size;
+		data_pos = ptr - PNGstream.data();
+		u32 crc = crc32_z(IDAT_crc, deflated_stream.data(), deflated_size);
 		writeValue<u32>(ptr, crc, false);
 		return;
 	}
@@ -458,40 +461,48 @@ PNG & PNG::operator=(const PNG & other){
 }
 
 PNG::Err PNG::read(const std::string & path){
-	PNGstream = readFile(path);
-	if(PNGstream.size() < PNG_MINIMUM_SIZE) return Err::UNRECOGNIZABLE;
-	const u8* ptr = PNGstream.data();
+	const MappedFile file(path, MappedFile::Access::SEQUENTIAL);
+	return read(file.span());
+}
+
+PNG::Err PNG::read(std::span<const u8> stream){
+	if(stream.size() < PNG_MINIMUM_SIZE) return Err::UNRECOGNIZABLE;
+	const u8* const begin = stream.data();
+	const u8* const end = begin + stream.size();
+	const u8* ptr = begin;
 	if(!std::equal(ptr, ptr + 8, correct_signature.begin())) return Err::INCORRECT_SIGNATURE;
 	ptr += 8;
 
 	z_stream z; z.zalloc = Z_NULL; z.zfree = Z_NULL; z.opaque = Z_NULL;
 	if(inflateInit(&z) != Z_OK) return Err::ZLIB_ERROR;
+	auto fail = [&z](const Err e){ inflateEnd(&z); return e; };
 
 	std::string chunk_type(4, '\0');
 	do{
 		u32 length = readBE<u32>(ptr);
+		if(length > static_cast<size_t>(end - ptr) - 8) return fail(Err::UNRECOGNIZABLE); // 種類 + データ + CRC32 が収まらない
 		std::copy(ptr, ptr + 4, chunk_type.data());
 		ptr += 4;
 
 		if(chunk_type == "IHDR"){
-			if(!read_IHDR(ptr, z)) return Err::UNRECOGNIZABLE;
+			if(!read_IHDR(ptr, begin, z)) return fail(Err::UNRECOGNIZABLE);
 		}
 		else if(chunk_type == "IDAT"){
-			if(!read_IDAT(ptr, length, z)) return Err::UNRECOGNIZABLE;
+			if(!read_IDAT(ptr, begin, length, z)) return fail(Err::UNRECOGNIZABLE);
 		}
 		else if(chunk_type == "IEND"){
-			if(ptr - PNGstream.data() < 49) return Err::UNRECOGNIZABLE;
-			inflateEnd(&z);
+			if(ptr - begin < 49) return fail(Err::UNRECOGNIZABLE);
 		}
 		else if(chunk_type == "PLTE"){
-			if(!read_PLTE(ptr, length)) return Err::UNRECOGNIZABLE;
+			if(!read_PLTE(ptr, begin, length)) return fail(Err::UNRECOGNIZABLE);
 		}
 		else{
-			if(ptr - PNGstream.data() < 37) return Err::UNRECOGNIZABLE;
+			if(ptr - begin < 37) return fail(Err::UNRECOGNIZABLE);
 			ptr += length;
 		}
 		ptr += 4; // CRC32
-	} while(chunk_type != "IEND" && ptr + PNG_MINIMUM_CHUNK_SIZE <= &*PNGstream.end());
+	} while(chunk_type != "IEND" && ptr + PNG_MINIMUM_CHUNK_SIZE <= end);
+	inflateEnd(&z);
 
 	if(has_pallet){
 		if(!read_indexed_stream()) return Err::UNRECOGNIZABLE;
@@ -507,16 +518,18 @@ void PNG::write(const std::string & path, u8 level){
 	level = std::clamp(static_cast<int>(level), 0, 9);
 	filterer();
 	auto deflated_stream = deflate_RLE(filtered_stream, level);
-	PNGstream.resize(deflated_stream.size() + PNG_MINIMUM_SIZE);
+	PNGstream.resize(PNG_MINIMUM_SIZE);
 	u8* ptr = PNGstream.data();
 
 	std::copy(correct_signature.begin(), correct_signature.end(), ptr);
 	ptr += correct_signature.size();
 
+	size_t data_pos;
 	write_IHDR(ptr);
-	write_IDAT(ptr, deflated_stream);
+	write_IDAT(ptr, deflated_stream, data_pos);
 	write_IEND(ptr);
-	writeFile(path, PNGstream);
+	const std::span<const u8> stream(PNGstream);
+	writeFileV(path, {stream.first(data_pos), deflated_stream, stream.subspan(data_pos)});
 }
 
 #endif
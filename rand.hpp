@@ -1,22 +1,306 @@
 #ifndef RAND_HPP
 #define RAND_HPP
 
+#include <algorithm>
+#include <bit>
+#include <mutex>
 #include <random>
+#include <span>
+#include <type_traits>
+#include <utility>
+
+#ifdef __AVX2__
+	#include <immintrin.h>
+#endif
 
 #include "int.hpp"
 #include "float.hpp"
 
+// 64bit を返す乱数生成器 いずれも std::uniform_int_distribution などにそのまま渡せる
 namespace Rand{
-	std::mt19937 state;
+	template <u32 Lanes> class Xoshiro256ppx;
+
+	// 状態 64bit 主に他の生成器の種を作るのに使う
+	class SplitMix64{
+		public:
+		using result_type = u64;
+		static constexpr u64 min(){ return 0; }
+		static constexpr u64 max(){ return U64MAX; }
+
+		constexpr SplitMix64(const u64 seed = 0) : s(seed) {}
+
+		constexpr u64 operator()(){
+			u64 z = (s += 0x9E3779B97F4A7C15ULL);
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+			return z ^ (z >> 31);
+		}
+
+		private:
+		u64 s;
+	};
+
+	// xoshiro256++ 状態 256bit 周期 2^256 - 1
+	class Xoshiro256pp{
+		public:
+		using result_type = u64;
+		static constexpr u64 min(){ return 0; }
+		static constexpr u64 max(){ return U64MAX; }
+
+		constexpr Xoshiro256pp(const u64 seed = 0){
+			SplitMix64 sm(seed);
+			for(u64 & x : s) x = sm();
+		}
+
+		constexpr u64 operator()(){
+			const u64 res = std::rotl(s[0] + s[3], 23) + s[0];
+			const u64 t = s[1] << 17;
+			s[2] ^= s[0];
+			s[3] ^= s[1];
+			s[1] ^= s[2];
+			s[0] ^= s[3];
+			s[2] ^= t;
+			s[3] = std::rotl(s[3], 45);
+			return res;
+		}
+
+		// 2^128 回進める 呼ぶたびに重ならない列が 2^128 個取れる
+		constexpr void jump(){
+			polynomial_jump({0x180EC6D33CFD0ABAULL, 0xD5A61266F0C9392CULL, 0xA9582618E03FC9AAULL, 0x39ABDC4529B1661CULL});
+		}
+
+		// 2^192 回進める jump で分けた列を更に束ねるときに使う
+		constexpr void long_jump(){
+			polynomial_jump({0x76E15D3EFEFDCBBFULL, 0xC5004E441C522FB3ULL, 0x77710069854EE241ULL, 0x39109BB02ACBE635ULL});
+		}
+
+		private:
+		template <u32 Lanes> friend class Xoshiro256ppx;
+		u64 s[4];
+
+		constexpr void polynomial_jump(const u64 (&poly)[4]){
+			u64 t[4] = {};
+			for(const u64 p : poly){
+				for(u32 b = 0; b < 64; ++b){
+					if((p >> b) & 1){
+						for(u32 i = 0; i < 4; ++i) t[i] ^= s[i];
+					}
+					(*this)();
+				}
+			}
+			for(u32 i = 0; i < 4; ++i) s[i] = t[i];
+		}
+	};
+
+#ifdef __SIZEOF_INT128__
+	// PCG64 DXSM 状態 128bit の LCG 周期 2^128
+	// stream ごとに別の列になる
+	class Pcg64{
+		public:
+		using result_type = u64;
+		static constexpr u64 min(){ return 0; }
+		static constexpr u64 max(){ return U64MAX; }
+
+		constexpr Pcg64(const u64 seed = 0, const u64 stream = 0){
+			inc = (u128(stream) << 1) | 1;
+			state = 0;
+			next();
+			state += seed;
+			next();
+		}
+
+		constexpr u64 operator()(){
+			// 進める前の状態から出力を作る
+			u64 hi = state >> 64;
+			const u64 lo = u64(state) | 1;
+			next();
+			hi ^= hi >> 32;
+			hi *= multiplier;
+			hi ^= hi >> 48;
+			return hi * lo;
+		}
+
+		// delta 回進める (O(log delta))
+		constexpr void advance(u128 delta){
+			u128 cur_mult = multiplier, cur_plus = inc, acc_mult = 1, acc_plus = 0;
+			while(delta > 0){
+				if(delta & 1){
+					acc_mult *= cur_mult;
+					acc_plus = acc_plus * cur_mult + cur_plus;
+				}
+				cur_plus = (cur_mult + 1) * cur_plus;
+				cur_mult *= cur_mult;
+				delta >>= 1;
+			}
+			state = acc_mult * state + acc_plus;
+		}
+
+		// 2^64 回進める
+		constexpr void jump(){
+			advance(u128(1) << 64);
+		}
+
+		private:
+		static constexpr u64 multiplier = 0xDA942042E4DD58B5ULL;
+		u128 state, inc;
+
+		constexpr void next(){
+			state = state * multiplier + inc;
+		}
+	};
+#endif
+
+	// Lanes 本の xoshiro256++ を並べたもの 本同士は jump で離してある
+	// fill は Lanes 本を同時に進めて、i 番目の出力を i % Lanes 本目から取る (AVX2 の有無で結果は変わらない)
+	template <u32 Lanes = 8>
+	class Xoshiro256ppx{
+		static_assert(Lanes % 4 == 0, "Lanes は4の倍数");
+
+		public:
+		static constexpr u32 lanes = Lanes;
+
+		Xoshiro256ppx(const u64 seed = 0) : Xoshiro256ppx(Xoshiro256pp(seed)) {}
+
+		// g から始めて jump しながら Lanes 本を取る g は最後の本の次まで進む
+		Xoshiro256ppx(Xoshiro256pp g){
+			for(u32 l = 0; l < Lanes; ++l){
+				for(u32 i = 0; i < 4; ++i) s[i][l] = g.s[i];
+				g.jump();
+			}
+		}
+
+		// out.size() が Lanes の倍数でないとき、最後の組の余りは捨てる
+		void fill(const std::span<u64> out){
+			fill_impl(out);
+		}
+
+		// [0, 1) 上位 52bit を仮数に使う
+		void fill(const std::span<f64> out){
+			fill_impl(out);
+		}
+
+		private:
+		alignas(32) u64 s[4][Lanes];
+
+		template <typename T>
+		void fill_impl(const std::span<T> out){
+			const size_t groups = out.size() / Lanes;
+			generate(out.data(), groups);
+			if(groups * Lanes < out.size()){
+				T rest[Lanes];
+				generate(rest, 1);
+				std::copy_n(rest, out.size() - groups * Lanes, out.begin() + groups * Lanes);
+			}
+		}
+
+		// Lanes 個ずつ groups 組を dst に書く 状態はその間レジスタに置いておく
+		template <typename T>
+		void generate(T* dst, const size_t groups){
+#ifdef __AVX2__
+			generate_avx2(dst, groups, std::make_integer_sequence<u32, Lanes / 4>());
+#else
+			// 1本ずつ状態をレジスタに載せて groups 個進める
+			for(u32 l = 0; l < Lanes; ++l){
+				Xoshiro256pp g;
+				for(u32 i = 0; i < 4; ++i) g.s[i] = s[i][l];
+				for(size_t k = 0; k < groups; ++k){
+					const u64 res = g();
+					if constexpr(std::is_same_v<T, u64>) dst[k * Lanes + l] = res;
+					else dst[k * Lanes + l] = std::bit_cast<f64>((res >> 12) | 0x3FF0000000000000ULL) - 1;
+				}
+				for(u32 i = 0; i < 4; ++i) s[i][l] = g.s[i];
+			}
+#endif
+		}
+
+#ifdef __AVX2__
+		// 4本ずつ V 組のベクトルを並べて進める V 組は畳み込み式で展開する
+		template <typename T, u32... V>
+		void generate_avx2(T* dst, const size_t groups, std::integer_sequence<u32, V...>){
+			__m256i s0[] = {load(s[0] + V * 4)...}, s1[] = {load(s[1] + V * 4)...};
+			__m256i s2[] = {load(s[2] + V * 4)...}, s3[] = {load(s[3] + V * 4)...};
+			auto round = [&](const u32 v, T* const out){
+				const __m256i sum = _mm256_add_epi64(s0[v], s3[v]);
+				const __m256i res = _mm256_add_epi64(_mm256_or_si256(_mm256_slli_epi64(sum, 23), _mm256_srli_epi64(sum, 41)), s0[v]);
+				if constexpr(std::is_same_v<T, u64>) _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), res);
+				else{
+					const __m256i bits = _mm256_or_si256(_mm256_srli_epi64(res, 12), _mm256_set1_epi64x(0x3FF0000000000000LL));
+					_mm256_storeu_pd(out, _mm256_sub_pd(_mm256_castsi256_pd(bits), _mm256_set1_pd(1)));
+				}
+				const __m256i t = _mm256_slli_epi64(s1[v], 17);
+				s2[v] = _mm256_xor_si256(s2[v], s0[v]);
+				s3[v] = _mm256_xor_si256(s3[v], s1[v]);
+				s1[v] = _mm256_xor_si256(s1[v], s2[v]);
+				s0[v] = _mm256_xor_si256(s0[v], s3[v]);
+				s2[v] = _mm256_xor_si256(s2[v], t);
+				s3[v] = _mm256_or_si256(_mm256_slli_epi64(s3[v], 45), _mm256_srli_epi64(s3[v], 19));
+			};
+			for(size_t g = 0; g < groups; ++g, dst += Lanes) (round(V, dst + V * 4), ...);
+			(store(s[0] + V * 4, s0[V]), ...);
+			(store(s[1] + V * 4, s1[V]), ...);
+			(store(s[2] + V * 4, s2[V]), ...);
+			(store(s[3] + V * 4, s3[V]), ...);
+		}
+
+		static __m256i load(const u64* const p){
+			return _mm256_load_si256(reinterpret_cast<const __m256i*>(p));
+		}
+		static void store(u64* const p, const __m256i v){
+			_mm256_store_si256(reinterpret_cast<__m256i*>(p), v);
+		}
+#endif
+	};
+
+	// スレッドごとの既定の生成器は、ここから long_jump で切り出す
+	// 最初に使ったスレッドが常に同じ列を受け取るので、1スレッドなら実行ごとに結果が変わらない
+	Xoshiro256pp split(){
+		static std::mutex mtx;
+		static Xoshiro256pp master;
+		std::lock_guard lock(mtx);
+		const Xoshiro256pp res = master;
+		master.long_jump();
+		return res;
+	}
+
+	thread_local Xoshiro256pp state = split();
+	thread_local Xoshiro256ppx<> bulk(split());
+
+	// このスレッドの state と bulk を seed から作り直す
+	void seed(const u64 s){
+		state = Xoshiro256pp(s);
+		Xoshiro256pp g(s);
+		g.long_jump();
+		bulk = Xoshiro256ppx<>(g);
+	}
+
+	u64 next(){
+		return state();
+	}
+	// [0, maximum)
 	u32 value(u32 maximum){
-		return u64(state()) * maximum >> 32;
+		return (state() >> 32) * maximum >> 32;
 	}
+	// [minimum, maximum)
 	u32 value(u32 minimum, u32 maximum){
-		return (u64(state()) * (maximum - minimum) >> 32) + minimum;
+		return ((state() >> 32) * (maximum - minimum) >> 32) + minimum;
 	}
+#ifdef __SIZEOF_INT128__
+	// [0, maximum)
+	u64 value64(u64 maximum){
+		return u128(state()) * maximum >> 64;
+	}
+#endif
+	// [0, 1)
 	f64 range01(){
-		static std::uniform_real_distribution<f64> dist(0.0, 1.0);
-		return dist(state);
+		return (state() >> 11) * 0x1p-53;
+	}
+
+	// 大量に作るときは bulk (AVX2 があれば8本を同時に進める) を使う
+	void fill(const std::span<u64> out){
+		bulk.fill(out);
+	}
+	void fill(const std::span<f64> out){
+		bulk.fill(out);
 	}
 }
 
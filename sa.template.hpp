@@ -1,4 +1,20 @@
+#ifndef SA_TEMPLATE_HPP
+#define SA_TEMPLATE_HPP
+
+#include <algorithm>
+#include <array>
+#include <barrier>
+#include <bit>
+#include <chrono>
 #include <cmath>
+#include <concepts>
+#include <functional>
+#include <limits>
+#include <random>
+#include <type_traits>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include "int.hpp"
 #include "float.hpp"
@@ -6,9 +22,182 @@
 #include "rand.hpp"
 
 namespace SA{
+	// 温度の予定: 進み具合 (0 ~ 1) から温度を返す
+	using Schedule = std::function<f64(f64)>;
+
+	// start から end へ指数的に下げる
+	Schedule exponential(const f64 start, const f64 end){
+		const f64 log_start = std::log(start), log_end = std::log(end);
+		return [=](const f64 ratio){ return std::exp(log_start + (log_end - log_start) * ratio); };
+	}
+
+	// start から end へ一定の割合で下げる
+	Schedule linear(const f64 start, const f64 end){
+		return [=](const f64 ratio){ return start + (end - start) * ratio; };
+	}
+
+	// base を cycles 回繰り返す 周回ごとに温度を decay 倍する
+	Schedule reheat(const Schedule base, const u32 cycles, const f64 decay = 1){
+		return [=](const f64 ratio){
+			const f64 x = std::min(ratio, 1.0) * cycles;
+			const u32 cycle = std::min<u32>(x, cycles - 1);
+			return base(x - cycle) * std::pow(decay, cycle);
+		};
+	}
+
+	// 時間を確かめる間隔 (試行回数) を、実際にかかった時間から決め直す
+	// 時計と温度の計算にかかる時間が全体の max_overhead 以下になり、かつ resolution ミリ秒以上は空かないようにする
+	class Cadence{
+		public:
+		Cadence(const f64 max_overhead = 0.001, const f64 resolution = 0.1){
+			period = std::min(check_cost() / max_overhead, resolution);
+		}
+
+		u32 size() const{
+			return batch;
+		}
+
+		// 直前の size() 回に elapsed ミリ秒かかった
+		void update(const f64 elapsed){
+			const f64 want = elapsed > 0 ? batch * period / elapsed : f64(batch) * 8;
+			batch = std::clamp<f64>(want, std::max<f64>(batch / 8, 1), std::min<f64>(f64(batch) * 8, 1 << 30));
+		}
+
+		private:
+		u32 batch = 1;
+		f64 period;
+
+		// 時計を読んで exp を1回計算するのにかかるミリ秒
+		static f64 check_cost(){
+			static const f64 cost = []{
+				constexpr u32 count = 256;
+				const auto begin = std::chrono::steady_clock::now();
+				volatile f64 sink = 0;
+				for(u32 i = 0; i < count; ++i){
+					const auto now = std::chrono::steady_clock::now();
+					sink = sink + std::exp(-f64((now - begin).count() & 0xFF) * 1e-3);
+				}
+				return std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - begin).count() / count;
+			}();
+			return cost;
+		}
+	};
+
+	// -log(u) を速く求める u は (0, 1] 絶対誤差は 1e-10 以下
+	// u = 2^k * m (sqrt(1/2) <= m < sqrt(2)) と分け、log(m) は s = (m - 1) / (m + 1) の級数で求める
+	inline f64 neg_log(const f64 u){
+		constexpr u64 mantissa = (1ULL << 52) - 1;
+		constexpr u64 one = 0x3FF0000000000000ULL;
+		const u64 bits = std::bit_cast<u64>(u);
+		// 仮数が sqrt(2) 以上なら指数を1つ繰り上げて仮数を半分にする
+		const u64 up = ((bits & mantissa) >= 0x6A09E667F3BCDULL) ? 1 : 0;
+		const f64 k = f64(i32(bits >> 52) - 1023 + i32(up));
+		const f64 m = std::bit_cast<f64>((bits & mantissa) | (one - (up << 52)));
+		const f64 s = (m - 1) / (m + 1), s2 = s * s;
+		const f64 series = s * (2 + s2 * (2.0 / 3 + s2 * (2.0 / 5 + s2 * (2.0 / 7 + s2 * (2.0 / 9 + s2 * (2.0 / 11))))));
+		return -(k * 0.6931471805599453 + series);
+	}
+
+	// 受理判定 diff <= 0 か、確率 exp(-diff / temp) で受理する
+	// u < exp(-diff / temp) と diff < temp * -log(u) は同じなので、-log(u) を batch 個まとめて作っておき、判定は掛け算と比較1回で済ませる
+	// 乱数を使うのは diff > 0 のときだけ
+	class Acceptor{
+		public:
+		static constexpr u32 batch = 256;
+
+		template <typename Rng>
+		bool operator()(const f64 diff, const f64 temp, Rng & rng){
+			if(diff <= 0) return true;
+			if(pos == batch) refill(rng);
+			return diff < temp * threshold[pos++];
+		}
+
+		private:
+		std::array<f64, batch> threshold;
+		u32 pos = batch;
+
+		template <typename Rng>
+		void refill(Rng & rng){
+			using R = typename Rng::result_type;
+			if constexpr(Rng::min() == 0 && Rng::max() == std::numeric_limits<R>::max() && std::numeric_limits<R>::digits >= 53){
+				// 上位 53 ビットから (0, 1] を作る 乱数を引くのと log を分けると後半はベクトル化される
+				for(auto & t : threshold) t = f64((u64(rng()) >> (std::numeric_limits<R>::digits - 53)) + 1) * 0x1p-53;
+			}
+			else{
+				for(auto & t : threshold) t = 1 - std::generate_canonical<f64, 53>(rng);
+			}
+			for(auto & t : threshold) t = neg_log(t);
+			pos = 0;
+		}
+	};
+
+	// 試行回数の集計
+	struct Counters{
+		u64 proposed = 0, accepted = 0, improved = 0; // improved: 受理された中でスコアが下がったもの
+	};
+
+	// 時間を確かめるごとに1つ残す記録
+	struct Sample{
+		f64 time, temp, score, best; // time は run を呼んでからのミリ秒
+		Counters batch; // 前の記録からの試行回数
+	};
+
+	// 最新の capacity 個の Sample を残す環状の記録 領域は reset でだけ確保する
+	class Trace{
+		public:
+		Trace(const size_t capacity = 0){
+			reset(capacity);
+		}
+
+		void reset(const size_t capacity){
+			buf.assign(capacity, Sample{});
+			head = 0;
+			recorded = 0;
+			sum = Counters();
+		}
+
+		void push(const Sample & s){
+			sum.proposed += s.batch.proposed;
+			sum.accepted += s.batch.accepted;
+			sum.improved += s.batch.improved;
+			recorded ++;
+			if(buf.empty()) return;
+			buf[head] = s;
+			if(++head == buf.size()) head = 0;
+		}
+
+		// 残っている数
+		size_t size() const{
+			return std::min<u64>(recorded, buf.size());
+		}
+
+		// 古い方から i 番目
+		const Sample & operator[](const size_t i) const{
+			return buf[recorded > buf.size() ? (head + i) % buf.size() : i];
+		}
+
+		// 溢れて捨てた分も含めた記録の数と合計
+		u64 pushed() const{
+			return recorded;
+		}
+		const Counters & totals() const{
+			return sum;
+		}
+
+		private:
+		std::vector<Sample> buf;
+		size_t head = 0;
+		u64 recorded = 0;
+		Counters sum;
+	};
+
+	// Trace を取らないときに代わりに置く 何も持たない
+	struct NoTrace{};
+
 	const f64 temp_log_start = 5, temp_log_end = -5;
+	Schedule schedule = exponential(std::exp(temp_log_start), std::exp(temp_log_end));
 	f64 temp = 0;
-	const u32 attemps_cnt_in_1misec = 1000;
+	Acceptor accept;
 	void core(){
 		/*
 		u32 r1 = Rand::value(L1),
@@ -18,17 +207,235 @@ namespace SA{
 		f64 diff = new_score - target.score();
 		// if(-diff + temp > 0){
 		// if(diff < 0 || Rand::range01() < std::exp(-diff / temp)){
+		// if(accept(diff, temp, Rand::state)){
 			target.execute(r1, r2, r3);
 		}
 		*/
 	}
 	void main(u32 time_limit = 1900){
-		u32 timer_mili;
-		while((timer_mili = Timer::milli()) < time_limit){
-			temp = std::exp(temp_log_start + (temp_log_end - temp_log_start) * timer_mili / time_limit);
-			for(u32 cnt = 0; cnt < attemps_cnt_in_1misec; ++cnt){
+		Cadence cadence;
+		f64 timer_mili = Timer::nano() * 1e-6;
+		while(timer_mili < time_limit){
+			temp = schedule(timer_mili / time_limit);
+			for(u32 cnt = cadence.size(); cnt > 0; --cnt){
 				core();
 			}
+			const f64 now = Timer::nano() * 1e-6;
+			cadence.update(now - timer_mili);
+			timer_mili = now;
 		}
 	}
 }
+
+// 焼きなましの状態 (スコアは小さいほど良い)
+// propose(rng) で近傍を1つ選び、delta(move) はそれを施したときのスコアの変化を返す
+// 受理されると apply(move)、棄却されると revert(move) が呼ばれる
+// delta が状態を書き換えないなら revert は何もしなくてよい delta の中で仮に施すなら revert で戻す
+template <typename S, typename Rng>
+concept AnnealState = std::copyable<S> && requires(S s, const S cs, Rng & rng, const typename S::Move & move){
+	{ s.propose(rng) } -> std::convertible_to<typename S::Move>;
+	{ s.delta(move) } -> std::convertible_to<f64>;
+	s.apply(move);
+	s.revert(move);
+	{ cs.score() } -> std::convertible_to<f64>;
+};
+
+struct AnnealOptions{
+	f64 time_limit = 1900; // ミリ秒 (run を呼んでから)
+	u32 threads = 1; // 鎖の数 1本に1スレッド
+	f64 temp_log_start = 5, temp_log_end = -5; // schedule が空なら exp(temp_log_start) から exp(temp_log_end) へ指数的に下げる
+	SA::Schedule schedule; // SA::exponential, SA::linear, SA::reheat など
+	// 時間を restarts + 1 個に区切り、区切りごとに schedule を最初からやり直す
+	// その際、鎖はそれまでの最良の状態に戻る
+	u32 restarts = 0;
+	// true: 温度を固定した鎖を threads 本並べ (レプリカ交換法)、exchange_interval ミリ秒ごとに隣同士で交換を試みる
+	// 梯子の温度は schedule(i / (threads - 1))
+	// false: 独立に焼きなます鎖を threads 本走らせる
+	bool tempering = false;
+	f64 exchange_interval = 1;
+	// 時間を確かめる間隔は、確かめる処理が全体の max_overhead 以下かつ resolution ミリ秒以下になるように実行中に決める
+	f64 max_overhead = 0.001, resolution = 0.1;
+	u64 seed = 0; // 鎖ごとにずらして使う
+	size_t trace_capacity = 4096; // Annealer の Traced が true のとき、鎖ごとに残す SA::Sample の数
+	AnnealOptions() {}
+};
+
+// 見つけた中で最も良い状態を返す
+// Traced が true なら鎖ごとに SA::Trace を取る false なら記録のための処理は全てコンパイルされない
+template <typename State, typename Rng = Rand::Xoshiro256pp, bool Traced = false>
+requires AnnealState<State, Rng>
+class Annealer{
+	public:
+	Annealer(const AnnealOptions & options_ = AnnealOptions()) : options(options_) {}
+
+	State run(const State & init){
+		const u32 k = std::max<u32>(options.threads, 1);
+		chains.clear();
+		chains.reserve(k);
+		for(u32 t = 0; t < k; ++t){
+			chains.emplace_back(init, Rng(options.seed + 0x9E3779B97F4A7C15ULL * (t + 1)));
+			if constexpr(Traced) chains[t].trace.reset(options.trace_capacity);
+		}
+		exchange_count = 0;
+		schedule = options.schedule ? options.schedule : SA::exponential(std::exp(options.temp_log_start), std::exp(options.temp_log_end));
+		start = std::chrono::steady_clock::now();
+
+		if(options.tempering && k > 1) run_tempering();
+		else run_threads([this](const u32 t){ run_independent(chains[t]); });
+
+		Chain * best = &chains[0];
+		total_iterations = 0;
+		for(auto & c : chains){
+			if(c.best_score < best->best_score) best = &c;
+			total_iterations += c.iterations;
+		}
+		best_score = best->best_score;
+		return best->best;
+	}
+
+	f64 score() const{ return best_score; } // 直前の run で見つけた最良のスコア
+	u64 iterations() const{ return total_iterations; } // 全ての鎖の試行回数の合計
+	u64 exchanges() const{ return exchange_count; } // レプリカ交換が成立した回数
+	u32 chain_count() const{ return chains.size(); } // 直前の run の鎖の数
+
+	// 鎖 t の記録 (直前の run)
+	const SA::Trace & trace(const u32 t) const requires Traced{
+		return chains[t].trace;
+	}
+
+	private:
+	struct Chain{
+		State state, best;
+		f64 cur, best_score;
+		Rng rng;
+		SA::Acceptor accept;
+		f64 temp = 0;
+		u64 iterations = 0;
+		u32 segment = 0;
+		[[no_unique_address]] std::conditional_t<Traced, SA::Trace, SA::NoTrace> trace;
+		Chain(const State & init, Rng && rng_) : state(init), best(init), cur(init.score()), best_score(cur), rng(std::move(rng_)) {}
+	};
+
+	AnnealOptions options;
+	SA::Schedule schedule;
+	std::vector<Chain> chains;
+	std::chrono::steady_clock::time_point start;
+	f64 best_score = 0;
+	u64 total_iterations = 0, exchange_count = 0;
+
+	f64 elapsed() const{
+		return std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// 鎖 t を f(t) で動かす 0本目は呼び出したスレッドが受け持つ
+	template <typename F>
+	void run_threads(F && f){
+		std::vector<std::thread> workers;
+		for(u32 t = 1; t < chains.size(); ++t) workers.emplace_back(f, t);
+		f(0);
+		for(auto & th : workers) th.join();
+	}
+
+	// 温度 temp で count 回試す Traced なら試行回数を数えて返す
+	static SA::Counters step(Chain & c, const u32 count, const f64 temp){
+		SA::Counters cnt;
+		for(u32 i = 0; i < count; ++i){
+			const auto move = c.state.propose(c.rng);
+			const f64 diff = c.state.delta(move);
+			if(c.accept(diff, temp, c.rng)){
+				if constexpr(Traced){
+					cnt.accepted ++;
+					cnt.improved += diff < 0;
+				}
+				c.state.apply(move);
+				c.cur += diff;
+				if(c.cur < c.best_score){
+					c.best_score = c.cur;
+					c.best = c.state;
+				}
+			}
+			else c.state.revert(move);
+		}
+		c.iterations += count;
+		cnt.proposed = count;
+		return cnt;
+	}
+
+	static void record(Chain & c, const f64 now, const f64 temp, const SA::Counters & cnt){
+		if constexpr(Traced) c.trace.push(SA::Sample{now, temp, c.cur, c.best_score, cnt});
+	}
+
+	void run_independent(Chain & c){
+		SA::Cadence cadence(options.max_overhead, options.resolution);
+		const f64 length = options.time_limit / (options.restarts + 1);
+		f64 now = elapsed();
+		while(now < options.time_limit){
+			const u32 segment = std::min<u32>(now / length, options.restarts);
+			if(segment != c.segment){
+				c.segment = segment;
+				c.state = c.best;
+				c.cur = c.best_score;
+			}
+			const f64 temp = schedule((now - segment * length) / length);
+			const SA::Counters cnt = step(c, cadence.size(), temp);
+			const f64 prev = now;
+			now = elapsed();
+			cadence.update(now - prev);
+			record(c, now, temp, cnt);
+		}
+	}
+
+	// 温度の梯子 temps[k] に鎖 order[k] を置き、区切りごとに全ての鎖を揃えてから隣同士の交換を試みる
+	void run_tempering(){
+		const u32 k = chains.size();
+		std::vector<f64> temps(k);
+		std::vector<u32> order(k);
+		for(u32 i = 0; i < k; ++i){
+			temps[i] = schedule(f64(i) / (k - 1));
+			order[i] = i;
+			chains[i].temp = temps[i];
+		}
+		Rng rng(options.seed);
+		std::uniform_real_distribution<f64> dist(0.0, 1.0);
+		u32 parity = 0;
+		bool stop = false;
+		f64 next_exchange = std::min(options.exchange_interval, options.time_limit);
+
+		auto exchange = [&]() noexcept{
+			// 受理確率 min(1, exp((1/T_i - 1/T_j)(E_i - E_j)))
+			for(u32 i = parity; i + 1 < k; i += 2){
+				const Chain & hot = chains[order[i]], & cold = chains[order[i + 1]];
+				const f64 x = (1 / temps[i] - 1 / temps[i + 1]) * (hot.cur - cold.cur);
+				if(x >= 0 || dist(rng) < std::exp(x)){
+					std::swap(order[i], order[i + 1]);
+					exchange_count ++;
+				}
+			}
+			parity ^= 1;
+			for(u32 i = 0; i < k; ++i) chains[order[i]].temp = temps[i];
+			const f64 now = elapsed();
+			stop = now >= options.time_limit;
+			next_exchange = std::min(now + options.exchange_interval, options.time_limit);
+		};
+		std::barrier sync(k, exchange);
+
+		run_threads([&](const u32 t){
+			Chain & c = chains[t];
+			SA::Cadence cadence(options.max_overhead, options.resolution);
+			f64 now = elapsed();
+			while(!stop){
+				while(now < next_exchange){
+					const SA::Counters cnt = step(c, cadence.size(), c.temp);
+					const f64 prev = now;
+					now = elapsed();
+					cadence.update(now - prev);
+					record(c, now, c.temp, cnt);
+				}
+				sync.arrive_and_wait();
+				now = elapsed();
+			}
+		});
+	}
+};
+
+#endif
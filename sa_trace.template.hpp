@@ -0,0 +1,33 @@
+#ifndef SA_TRACE_TEMPLATE_HPP
+#define SA_TRACE_TEMPLATE_HPP
+
+#include <charconv>
+#include <string>
+#include <vector>
+
+#include "sa.template.hpp"
+#include "csv.hpp"
+
+// Annealer の記録を CSV に書き出す csv.hpp を使うので -lz が必要
+namespace SA{
+	// 全ての鎖の記録を chain,time,temp,score,best,proposed,accepted,improved の列で CSV::write に渡す
+	template <typename State, typename Rng>
+	bool dump(const Annealer<State, Rng, true> & annealer, const std::string & path, const CSV::WriteOptions & w_op = {}){
+		std::vector<std::vector<std::string>> rows = {{"chain", "time", "temp", "score", "best", "proposed", "accepted", "improved"}};
+		auto str = [](const auto x){
+			char buf[32];
+			return std::string(buf, std::to_chars(buf, buf + sizeof(buf), x).ptr);
+		};
+		for(u32 t = 0; t < annealer.chain_count(); ++t){
+			const Trace & tr = annealer.trace(t);
+			for(size_t i = 0; i < tr.size(); ++i){
+				const Sample & s = tr[i];
+				rows.push_back({str(t), str(s.time), str(s.temp), str(s.score), str(s.best),
+					str(s.batch.proposed), str(s.batch.accepted), str(s.batch.improved)});
+			}
+		}
+		return CSV(rows).write(path, w_op);
+	}
+}
+
+#endif
@@ -7,10 +7,17 @@ const std::string src_path = "cases/csv/in/";
 const std::string dst_path = "cases/csv/out/";
 
 int main(){
-	auto paths = getFileList(src_path);
-	for(auto path : paths){
-		std::clog << path << ":\n";
-		CSV csv(src_path + path);
+	// 読み込みと解析はワーカースレッドで先に進めておく
+	FileLoader<CSV> loader(findFiles(src_path, {".csv"}, false), [](const FileEntry &, std::vector<u8> && bytes){
+		CSV csv;
+		csv.read(bytes);
+		return csv;
+	});
+	FileEntry file;
+	CSV csv;
+	while(loader.next(file, csv)){
+		const std::string name = std::filesystem::path(file.path).filename().string();
+		std::clog << name << ":\n";
 		for(const auto & row : csv){
 			for(const std::string & el : row){
 				std::clog << el << ',';
@@ -18,6 +25,6 @@ int main(){
 			std::clog << '\n';
 		}
 		std::clog << '\n';
-		csv.write(dst_path + path);
+		csv.write(dst_path + name);
 	}
 }
@@ -0,0 +1,64 @@
+// g++ -std=c++20 -O2 -mavx2 rand_bench.cpp
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../rand.hpp"
+#include "../timer.hpp"
+
+// 1個あたりの ns を表示する
+template <typename F>
+void measure(const std::string & name, const u32 count, F && f){
+	Timer::start();
+	const u64 check = f();
+	const u64 ns = Timer::nano();
+	std::cout << "  " << name << ": " << f64(ns) / count << " ns/u64 (" << check << ")\n";
+}
+
+// 1個ずつ引く 32bit の生成器は2回で 64bit とする
+template <typename G>
+void bench_engine(const std::string & name, G g, const u32 count){
+	measure(name, count, [&]{
+		u64 x = 0;
+		for(u32 i = 0; i < count; ++i){
+			if constexpr(sizeof(typename G::result_type) >= 8) x += g();
+			else x += (u64(g()) << 32) | g();
+		}
+		return x;
+	});
+}
+
+int main(){
+	const u32 count = 1 << 26;
+	std::cout << "scalar\n";
+	bench_engine("mt19937", std::mt19937(1), count);
+	bench_engine("mt19937_64", std::mt19937_64(1), count);
+	bench_engine("SplitMix64", Rand::SplitMix64(1), count);
+	bench_engine("Xoshiro256pp", Rand::Xoshiro256pp(1), count);
+	bench_engine("Pcg64", Rand::Pcg64(1), count);
+	measure("Rand::next (thread_local)", count, [&]{
+		u64 x = 0;
+		for(u32 i = 0; i < count; ++i) x += Rand::next();
+		return x;
+	});
+
+	std::cout << "fill (" << (1 << 12) << " 個ずつ)\n";
+	std::vector<u64> buf(1 << 12);
+	auto bench_fill = [&](const std::string & name, auto && fill){
+		measure(name, count, [&]{
+			u64 x = 0;
+			for(u32 i = 0; i < count; i += buf.size()){
+				fill(buf);
+				x += buf[0] + buf.back();
+			}
+			return x;
+		});
+	};
+	Rand::Xoshiro256pp g(1);
+	bench_fill("Xoshiro256pp loop", [&](std::vector<u64> & v){ for(u64 & y : v) y = g(); });
+	Rand::Xoshiro256ppx<4> x4(1);
+	bench_fill("Xoshiro256ppx<4>", [&](std::vector<u64> & v){ x4.fill(v); });
+	Rand::Xoshiro256ppx<8> x8(1);
+	bench_fill("Xoshiro256ppx<8>", [&](std::vector<u64> & v){ x8.fill(v); });
+	bench_fill("Rand::fill", [&](std::vector<u64> & v){ Rand::fill(v); });
+}
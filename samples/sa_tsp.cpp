@@ -0,0 +1,109 @@
+// g++ -std=c++20 -O2 -mavx2 -pthread sa_tsp.cpp -lz
+#include <iostream>
+#include <string>
+
+#include "../sa_trace.template.hpp"
+
+struct Point{
+	f64 x, y;
+};
+
+// 巡回路を 2-opt (区間の反転) で焼きなます
+struct Tour{
+	struct Move{
+		u32 i, j;
+	};
+
+	const std::vector<Point> * points;
+	std::vector<u32> order;
+	f64 length = 0;
+
+	Tour(const std::vector<Point> & points_) : points(&points_), order(points_.size()){
+		for(u32 i = 0; i < order.size(); ++i) order[i] = i;
+		for(u32 i = 0; i < order.size(); ++i) length += dist(i, next(i));
+	}
+
+	f64 score() const{
+		return length;
+	}
+
+	// order[i + 1 .. j] を反転する
+	template <typename Rng>
+	Move propose(Rng & rng){
+		const u32 n = order.size();
+		u32 i = rng() % n, j = rng() % (n - 1);
+		if(j >= i) j ++;
+		if(i > j) std::swap(i, j);
+		return Move{i, j};
+	}
+
+	f64 delta(const Move & m) const{
+		return dist(m.i, m.j) + dist(m.i + 1, next(m.j)) - dist(m.i, m.i + 1) - dist(m.j, next(m.j));
+	}
+
+	void apply(const Move & m){
+		length += delta(m);
+		std::reverse(order.begin() + m.i + 1, order.begin() + m.j + 1);
+	}
+
+	void revert(const Move &) {}
+
+	private:
+	u32 next(const u32 i) const{
+		return i + 1 == order.size() ? 0 : i + 1;
+	}
+
+	f64 dist(const u32 a, const u32 b) const{
+		const Point & p = (*points)[order[a]], & q = (*points)[order[b]];
+		return std::hypot(p.x - q.x, p.y - q.y);
+	}
+};
+
+int main(){
+	std::mt19937_64 gen(1);
+	std::uniform_real_distribution<f64> coord(0, 1000);
+	std::vector<Point> points(300);
+	for(auto & p : points) p = Point{coord(gen), coord(gen)};
+	const Tour init(points);
+	std::cout << "initial: " << init.score() << "\n";
+
+	const u32 threads = std::max(1u, std::thread::hardware_concurrency());
+	auto report = [&](const std::string & name, AnnealOptions options){
+		options.time_limit = 1000;
+		Annealer<Tour> annealer(options);
+		const Tour best = annealer.run(init);
+		std::cout << name << " x" << options.threads << ": "
+			<< best.score() << " (" << annealer.iterations() << " moves, " << annealer.exchanges() << " exchanges)\n";
+	};
+
+	AnnealOptions options;
+	options.threads = threads;
+	options.schedule = SA::exponential(100, 0.1);
+	report("exponential", options);
+
+	options.schedule = SA::linear(100, 0.1);
+	report("linear", options);
+
+	options.schedule = SA::reheat(SA::exponential(100, 0.1), 4, 0.5);
+	report("reheat x4", options);
+
+	options.schedule = SA::exponential(100, 0.1);
+	options.restarts = 3;
+	report("restarts x3", options);
+
+	options.restarts = 0;
+	options.threads = std::max(threads, 4u);
+	options.tempering = true;
+	report("tempering", options);
+
+	// 記録を取って CSV に書き出す
+	options.threads = threads;
+	options.tempering = false;
+	options.time_limit = 1000;
+	Annealer<Tour, Rand::Xoshiro256pp, true> traced(options);
+	const Tour best = traced.run(init);
+	const SA::Counters & total = traced.trace(0).totals();
+	std::cout << "traced x" << options.threads << ": " << best.score() << " (" << traced.iterations() << " moves, "
+		<< 100.0 * total.accepted / total.proposed << "% accepted, " << traced.trace(0).pushed() << " samples)\n";
+	SA::dump(traced, "sa_tsp_trace.csv");
+}
@@ -0,0 +1,258 @@
+// g++ -std=c++20 -O2 -mavx2 segtree_bench.cpp
+// ./a.out [最大の n の桁数 (既定 7)]
+#include <bit>
+#include <iostream>
+#include <string>
+
+#include "../segtree.template.hpp"
+#include "../wide_segtree.template.hpp"
+#include "../fenwick.template.hpp"
+#include "../sparse_table.template.hpp"
+#include "../timer.hpp"
+#include "../rand.hpp"
+
+// 書き換え式の SegTree (op を直接書いたもの) との比較用
+template <typename T, T e>
+class SegTreeHand{
+	public:
+	SegTreeHand(const std::vector<T> & vec){
+		lg = bit_ceil_exp(vec.size());
+		sz = 1ULL << lg;
+		dt.resize(sz + sz, e);
+		std::copy(vec.begin(), vec.end(), dt.begin() + sz);
+		for(size_t i = sz - 1; i > 0; --i) dt[i] = dt[i + i] + dt[i + i + 1];
+	}
+	void set(size_t dst, const T value){
+		dst += sz;
+		dt[dst] = value;
+		while((dst >>= 1) > 0) dt[dst] = dt[dst + dst] + dt[dst + dst + 1];
+	}
+	T range1(size_t l, size_t r) const{
+		l += sz; r += sz;
+		T resl = e, resr = e;
+		while(l < r){
+			if((l & 1) == 1) resl = resl + dt[l++];
+			if((r & 1) == 1) resr = dt[--r] + resr;
+			l >>= 1;
+			r >>= 1;
+		}
+		return resl + resr;
+	}
+	private:
+	u32 lg;
+	size_t sz;
+	std::vector<T> dt;
+};
+
+struct Query{
+	u32 l, r;
+};
+
+std::vector<Query> make_queries(const u32 n, const u32 count){
+	std::vector<Query> res(count);
+	for(auto & q : res){
+		q.l = Rand::value(n);
+		q.r = Rand::value(q.l, n) + 1;
+	}
+	return res;
+}
+
+// 1回あたりの ns を表示する
+template <typename F>
+void measure(const std::string & name, const u32 count, F && f){
+	Timer::start();
+	const u64 check = f();
+	const u64 ns = Timer::nano();
+	std::cout << "  " << name << ": " << f64(ns) / count << " ns/op (" << check << ")\n";
+}
+
+// 書き換え式との比較 (Monoid を通しても遅くならないこと)
+void bench_monoid(){
+	const u32 count = 1 << 22;
+	for(const u32 n : {1000u, 1000000u}){
+		std::vector<u64> init(n);
+		for(auto & x : init) x = Rand::value(1000);
+		const auto queries = make_queries(n, count);
+
+		std::cout << "n = " << n << "\n";
+		SegTreeHand<u64, 0> hand(init);
+		SegTree<u64, Monoid::Sum<u64>> tree(init);
+		measure("hand range1", count, [&]{
+			u64 s = 0;
+			for(const auto & q : queries) s += hand.range1(q.l, q.r);
+			return s;
+		});
+		measure("monoid range1", count, [&]{
+			u64 s = 0;
+			for(const auto & q : queries) s += tree.range1(q.l, q.r);
+			return s;
+		});
+		measure("hand set", count, [&]{
+			for(const auto & q : queries) hand.set(q.l, q.r);
+			return hand.range1(0, n);
+		});
+		measure("monoid set", count, [&]{
+			for(const auto & q : queries) tree.set(q.l, q.r);
+			return tree.range1(0, n);
+		});
+	}
+}
+
+// 二分木と B 分木の比較
+template <typename M>
+void bench_wide(const std::string & name, const u32 max_digits){
+	const u32 count = 1 << 21;
+	u32 n = 1000;
+	for(u32 d = 3; d <= max_digits; ++d, n *= 10){
+		std::vector<u32> init(n);
+		for(auto & x : init) x = Rand::value(1000000);
+		const auto queries = make_queries(n, count);
+
+		std::cout << name << " n = " << n << "\n";
+		{
+			SegTree<u32, M> tree(init);
+			measure("SegTree range1", count, [&]{
+				u64 s = 0;
+				for(const auto & q : queries) s += tree.range1(q.l, q.r);
+				return s;
+			});
+			measure("SegTree set", count, [&]{
+				for(const auto & q : queries) tree.set(q.l, q.r);
+				return u64(tree.range1(0, n));
+			});
+		}
+		{
+			WideSegTree<u32, M, 16> tree(init);
+			measure("WideSegTree range1", count, [&]{
+				u64 s = 0;
+				for(const auto & q : queries) s += tree.range1(q.l, q.r);
+				return s;
+			});
+			measure("WideSegTree set", count, [&]{
+				for(const auto & q : queries) tree.set(q.l, q.r);
+				return u64(tree.range1(0, n));
+			});
+		}
+	}
+}
+
+// 1つずつの range1, set とまとめて渡す版の比較
+void bench_batch(const u32 max_digits){
+	const u32 count = 1 << 21;
+	const u32 threads = std::max(1u, std::thread::hardware_concurrency());
+	u32 n = 100000;
+	for(u32 d = 5; d <= max_digits; ++d, n *= 10){
+		std::vector<u64> init(n);
+		for(auto & x : init) x = Rand::value(1000);
+		const auto queries = make_queries(n, count);
+		std::vector<std::pair<size_t, size_t>> pairs(count);
+		std::vector<std::pair<size_t, u64>> updates(count);
+		for(u32 i = 0; i < count; ++i){
+			pairs[i] = {queries[i].l, queries[i].r};
+			updates[i] = {queries[i].l, queries[i].r};
+		}
+		std::vector<u64> out(count);
+
+		std::cout << "batch n = " << n << "\n";
+		SegTree<u64> tree(init);
+		measure("range1", count, [&]{
+			u64 s = 0;
+			for(const auto & q : queries) s += tree.range1(q.l, q.r);
+			return s;
+		});
+		measure("range1 batch", count, [&]{
+			tree.range1(pairs, out);
+			u64 s = 0;
+			for(const u64 x : out) s += x;
+			return s;
+		});
+		measure("range1 batch x" + std::to_string(threads), count, [&]{
+			tree.range1(pairs, out, threads);
+			u64 s = 0;
+			for(const u64 x : out) s += x;
+			return s;
+		});
+		measure("set", count, [&]{
+			for(const auto & [p, v] : updates) tree.set(p, v);
+			return tree.range1(0, n);
+		});
+		measure("set batch", count, [&]{
+			tree.set(updates);
+			return tree.range1(0, n);
+		});
+		const std::span<const std::pair<size_t, u64>> few(updates.data(), n / 64);
+		measure("set batch (n/64)", few.size(), [&]{
+			tree.set(few);
+			return tree.range1(0, n);
+		});
+		measure("set (n/64)", few.size(), [&]{
+			for(const auto & [p, v] : few) tree.set(p, v);
+			return tree.range1(0, n);
+		});
+	}
+}
+
+// 用途ごとにどれが速いか
+// 一点加算 + 区間和: SegTree, WideSegTree, Fenwick
+// 変更無し + 区間最小: SegTree, WideSegTree, SparseTable
+void bench_companions(const u32 max_digits){
+	const u32 count = 1 << 21;
+	u32 n = 1000;
+	for(u32 d = 3; d <= max_digits; ++d, n *= 10){
+		std::vector<u32> init(n);
+		for(auto & x : init) x = Rand::value(1000000);
+		const auto queries = make_queries(n, count);
+
+		std::cout << "add + sum n = " << n << "\n";
+		const auto add_sum = [&](auto & tree, auto && add){
+			u64 s = 0;
+			for(u32 i = 0; i < count; ++i){
+				const auto & q = queries[i];
+				if((i & 1) == 0) add(tree, q.l, q.r);
+				else s += tree.range1(q.l, q.r);
+			}
+			return s;
+		};
+		{
+			SegTree<u32> tree(init);
+			measure("SegTree", count, [&]{ return add_sum(tree, [](auto & t, u32 p, u32 v){ t.set(p, t.at(p) + v); }); });
+		}
+		{
+			WideSegTree<u32> tree(init);
+			measure("WideSegTree", count, [&]{ return add_sum(tree, [](auto & t, u32 p, u32 v){ t.set(p, t.at(p) + v); }); });
+		}
+		{
+			Fenwick<u32> tree(init);
+			measure("Fenwick", count, [&]{ return add_sum(tree, [](auto & t, u32 p, u32 v){ t.add(p, v); }); });
+		}
+
+		std::cout << "static min n = " << n << "\n";
+		const auto range_min = [&](const auto & tree){
+			u64 s = 0;
+			for(const auto & q : queries) s += tree.range1(q.l, q.r);
+			return s;
+		};
+		{
+			const SegTree<u32, Monoid::Min<u32>> tree(init);
+			measure("SegTree", count, [&]{ return range_min(tree); });
+		}
+		{
+			const WideSegTree<u32, Monoid::Min<u32>> tree(init);
+			measure("WideSegTree", count, [&]{ return range_min(tree); });
+		}
+		// 表は n * bit_width(n) 要素になるので、2 GiB を超える大きさでは作らない
+		if(size_t(n) * std::bit_width(n) * sizeof(u32) <= (size_t(2) << 30)){
+			const SparseTable<u32, Monoid::Min<u32>> tree(init);
+			measure("SparseTable", count, [&]{ return range_min(tree); });
+		}
+	}
+}
+
+int main(int argc, char ** argv){
+	const u32 max_digits = argc > 1 ? std::stoi(argv[1]) : 7;
+	bench_monoid();
+	bench_wide<Monoid::Sum<u32>>("sum", max_digits);
+	bench_wide<Monoid::Min<u32>>("min", max_digits);
+	bench_batch(max_digits);
+	bench_companions(max_digits);
+}
@@ -1,5 +1,15 @@
+#ifndef SEGTREE_TEMPLATE_HPP
+#define SEGTREE_TEMPLATE_HPP
+
 #include <vector>
 #include <algorithm>
+#include <bit>
+#include <concepts>
+#include <limits>
+#include <numeric>
+#include <span>
+#include <thread>
+#include <utility>
 
 #include "int.hpp"
 
@@ -8,20 +18,74 @@ u8 bit_ceil_exp(u64 n){
 	return (((n & (n - 1)) == 0 ? 63 : 64) - __builtin_clzll(n));
 }
 
-// e: 単位元
-template <typename T, T e>
+// モノイド: 結合的な op(a, b) と単位元 identity() を static に持つ型 (identity() は constexpr)
+template <typename M, typename T>
+concept MonoidOf = requires(const T a){
+	{ M::identity() } -> std::convertible_to<T>;
+	{ M::op(a, a) } -> std::convertible_to<T>;
+};
+
+namespace Monoid{
+	template <typename T>
+	struct Sum{
+		static constexpr T identity(){ return T(0); }
+		static constexpr T op(const T a, const T b){ return a + b; }
+	};
+
+	template <typename T>
+	struct Min{
+		static constexpr T identity(){
+			if constexpr(std::numeric_limits<T>::has_infinity) return std::numeric_limits<T>::infinity();
+			else return std::numeric_limits<T>::max();
+		}
+		static constexpr T op(const T a, const T b){ return b < a ? b : a; }
+	};
+
+	template <typename T>
+	struct Max{
+		static constexpr T identity(){
+			if constexpr(std::numeric_limits<T>::has_infinity) return -std::numeric_limits<T>::infinity();
+			else return std::numeric_limits<T>::lowest();
+		}
+		static constexpr T op(const T a, const T b){ return a < b ? b : a; }
+	};
+
+	template <typename T>
+	struct Xor{
+		static constexpr T identity(){ return T(0); }
+		static constexpr T op(const T a, const T b){ return a ^ b; }
+	};
+
+	template <typename T>
+	struct Gcd{
+		static constexpr T identity(){ return T(0); }
+		static constexpr T op(const T a, const T b){ return std::gcd(a, b); }
+	};
+
+	// x -> a * x + b の合成 op(f, g) は f の後に g を施す
+	template <typename T>
+	struct Affine{
+		struct Map{
+			T a = 1, b = 0;
+			constexpr T operator()(const T x) const{ return a * x + b; }
+			constexpr bool operator==(const Map &) const = default;
+		};
+		static constexpr Map identity(){ return Map{}; }
+		static constexpr Map op(const Map f, const Map g){ return Map{f.a * g.a, f.b * g.a + g.b}; }
+	};
+}
+
+// M: モノイド (Monoid::Sum など)
+template <typename T, MonoidOf<T> M = Monoid::Sum<T>>
 class SegTree{
 	private:
-	inline T op(const T a, const T b) const{
-		T res;
-		/* -- ここを書き換える -- */
-		res = a + b;
-
-		return res;
+	static constexpr T e = M::identity();
+	static inline T op(const T a, const T b){
+		return M::op(a, b);
 	}
 
-	u32 lg;
-	size_t sz;
+	u32 lg = 0;
+	size_t sz = 0;
 	std::vector<T> dt;
 
 	SegTree() = delete;
@@ -86,6 +150,37 @@ class SegTree{
 		return op(resl, resr);
 	}
 
+	// まとめて [l, r) を求め out に書く
+	// 少し先の問い合わせを先読みしてメモリの待ち時間を重ねる
+	// 読むだけなので threads 本のスレッドに分けてよい
+	void range1(const std::span<const std::pair<size_t, size_t>> queries, const std::span<T> out, const u32 threads = 1) const{
+		const size_t cnt = queries.size();
+		const size_t per = std::max<size_t>((cnt + threads - 1) / std::max<u32>(threads, 1), batch_min_per_thread);
+		if(per >= cnt){
+			range1_prefetch(queries.data(), out.data(), cnt);
+			return;
+		}
+		std::vector<std::thread> workers;
+		for(size_t from = per; from < cnt; from += per){
+			workers.emplace_back([=, this]{ range1_prefetch(queries.data() + from, out.data() + from, std::min(per, cnt - from)); });
+		}
+		range1_prefetch(queries.data(), out.data(), per);
+		for(auto & th : workers) th.join();
+	}
+
+	// まとめて set する 同じ位置は後のものが勝つ
+	// 更新の数 k 以上の幅がある段までは各々の経路を計算し直し、それより上の段 (2k 節点未満) は1度だけ全て計算し直す
+	void set(const std::span<const std::pair<size_t, T>> updates){
+		if(updates.empty()) return;
+		const size_t top = std::min<size_t>(std::bit_floor(updates.size()) * 2, sz);
+		for(const auto & [pos, value] : updates){
+			size_t dst = sz + pos;
+			dt[dst] = value;
+			while((dst >>= 1) >= top) dt[dst] = op(dt[dst + dst], dt[dst + dst + 1]);
+		}
+		for(size_t dst = top; --dst > 0;) dt[dst] = op(dt[dst + dst], dt[dst + dst + 1]);
+	}
+
 	size_t lower_find(const T val, size_t l = 0) const{
 		T cur = e, next;
 		if(dt[sz + l] >= val) return l;
@@ -114,6 +209,23 @@ class SegTree{
 
 
 	private:
+	static constexpr u32 prefetch_ahead = 16, prefetch_levels = 6;
+	static constexpr size_t batch_min_per_thread = 1 << 14;
+
+	// prefetch_ahead 個先の問い合わせについて、葉から prefetch_levels 段分の両端を先読みしておく
+	void range1_prefetch(const std::pair<size_t, size_t> * const queries, T * const out, const size_t cnt) const{
+		for(size_t i = 0; i < cnt; ++i){
+			if(i + prefetch_ahead < cnt){
+				const size_t l = queries[i + prefetch_ahead].first + sz, r = queries[i + prefetch_ahead].second + sz - 1;
+				for(u32 d = 0; d < prefetch_levels; ++d){
+					__builtin_prefetch(dt.data() + (l >> d));
+					__builtin_prefetch(dt.data() + (r >> d));
+				}
+			}
+			out[i] = range1(queries[i].first, queries[i].second);
+		}
+	}
+
 	void update_all(){
 		size_t dst = sz;
 		while(--dst > 0){
@@ -121,3 +233,5 @@ class SegTree{
 		}
 	}
 };
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef SPARSE_TABLE_TEMPLATE_HPP
+#define SPARSE_TABLE_TEMPLATE_HPP
+
+#include <bit>
+
+#include "segtree.template.hpp"
+
+// 変更の無い列に対する区間の問い合わせを O(1) で返す
+// op は冪等であること (Monoid::Min, Max, Gcd など) 重なる2区間を合わせて答える
+template <typename T, MonoidOf<T> M = Monoid::Min<T>>
+class SparseTable{
+	private:
+	static constexpr T e = M::identity();
+
+	size_t n;
+	// 段 k は dt[base[k]] から始まり、i 番目は [i, i + 2^k) の値
+	std::vector<size_t> base;
+	std::vector<T> dt;
+
+	SparseTable() = delete;
+
+
+	public:
+	SparseTable(const std::vector<T> & vec){
+		n = vec.size();
+		size_t total = 0;
+		for(size_t w = 1; w <= n; w <<= 1){
+			base.push_back(total);
+			total += n - w + 1;
+		}
+		dt.resize(total);
+		std::copy(vec.begin(), vec.end(), dt.begin());
+		for(size_t k = 1; k < base.size(); ++k){
+			const size_t half = size_t(1) << (k - 1);
+			const T* const prev = &dt[base[k - 1]];
+			T* const cur = &dt[base[k]];
+			for(size_t i = 0; i + half + half <= n; ++i) cur[i] = M::op(prev[i], prev[i + half]);
+		}
+	}
+
+	size_t size() const{
+		return n;
+	}
+
+	T at(const size_t ofs) const{
+		return dt[ofs];
+	}
+
+	// [l, r]
+	T range0(const size_t l, const size_t r) const{
+		return range1(l, r + 1);
+	}
+
+	// [l, r)
+	T range1(const size_t l, const size_t r) const{
+		if(l >= r) return e;
+		const u32 k = std::bit_width(r - l) - 1;
+		const T* const level = &dt[base[k]];
+		return M::op(level[l], level[r - (size_t(1) << k)]);
+	}
+};
+
+#endif
@@ -0,0 +1,183 @@
+#ifndef WIDE_SEGTREE_TEMPLATE_HPP
+#define WIDE_SEGTREE_TEMPLATE_HPP
+
+#include <new>
+#include <type_traits>
+
+#ifdef __AVX2__
+	#include <immintrin.h>
+#endif
+
+#include "segtree.template.hpp"
+
+// 64バイト境界に置くアロケータ
+template <typename T, size_t Align = 64>
+struct AlignedAllocator{
+	using value_type = T;
+	template <typename U> struct rebind{ using other = AlignedAllocator<U, Align>; };
+	AlignedAllocator() = default;
+	template <typename U> AlignedAllocator(const AlignedAllocator<U, Align> &) {}
+	T* allocate(const size_t n){
+		return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Align)));
+	}
+	void deallocate(T* p, size_t){
+		::operator delete(p, std::align_val_t(Align));
+	}
+	template <typename U> bool operator==(const AlignedAllocator<U, Align> &) const{ return true; }
+};
+
+// 各節点が B 個の子をまとめる SegTree
+// 段の数が log_B n に減るので、n が大きいときのキャッシュミスが少ない
+// 整数の Sum, Min, Max は AVX2 で B 個をまとめて畳み込む
+template <typename T, MonoidOf<T> M = Monoid::Sum<T>, u32 B = 16>
+class WideSegTree{
+	static_assert(B >= 2 && (B & (B - 1)) == 0, "B は2の冪");
+
+	private:
+	static constexpr T e = M::identity();
+	static inline T op(const T a, const T b){
+		return M::op(a, b);
+	}
+
+	size_t n;
+	// 段 k は dt[base[k]] から始まり、B 個ずつの塊に分かれている 最上段は1塊
+	std::vector<size_t> base;
+	std::vector<T, AlignedAllocator<T>> dt;
+
+	WideSegTree() = delete;
+
+
+	public:
+	WideSegTree(const size_t _n, const T init = e) : WideSegTree(std::vector<T>(_n, init)) {}
+	WideSegTree(const std::vector<T> & vec){
+		n = vec.size();
+		size_t total = 0, len = n;
+		while(true){
+			const size_t blocks = std::max<size_t>((len + B - 1) / B, 1);
+			base.push_back(total);
+			total += blocks * B;
+			if(blocks == 1) break;
+			len = blocks;
+		}
+		dt.assign(total, e);
+		std::copy(vec.begin(), vec.end(), dt.begin());
+		for(size_t k = 0; k + 1 < base.size(); ++k){
+			const size_t blocks = (base[k + 1] - base[k]) / B;
+			for(size_t b = 0; b < blocks; ++b) dt[base[k + 1] + b] = reduce(&dt[base[k] + b * B], 0, B);
+		}
+	}
+
+	size_t size() const{
+		return n;
+	}
+
+	void set(size_t dst, const T value){
+		dt[dst] = value;
+		for(size_t k = 0; k + 1 < base.size(); ++k){
+			dst /= B;
+			dt[base[k + 1] + dst] = reduce(&dt[base[k] + dst * B], 0, B);
+		}
+	}
+
+	T at(const size_t ofs) const{
+		return dt[ofs];
+	}
+
+	// [l, r]
+	T range0(const size_t l, const size_t r) const{
+		return range1(l, r + 1);
+	}
+
+	// [l, r)
+	// 各段で左右の端の塊だけを畳み込み、残りは1つ上の段に任せる
+	T range1(size_t l, size_t r) const{
+		T resl = e, resr = e;
+		for(size_t k = 0; l < r; ++k){
+			const T* const level = &dt[base[k]];
+			if(k + 1 == base.size()) return op(op(resl, reduce(level, l, r)), resr);
+			size_t lb = l / B;
+			const size_t rb = r / B;
+			if(lb == rb) return op(op(resl, reduce(level + lb * B, l % B, r % B)), resr);
+			if(l % B != 0) resl = op(resl, reduce(level + lb++ * B, l % B, B));
+			if(r % B != 0) resr = op(reduce(level + rb * B, 0, r % B), resr);
+			l = lb;
+			r = rb;
+		}
+		return op(resl, resr);
+	}
+
+	T all() const{
+		return reduce(&dt[base.back()], 0, B);
+	}
+
+
+	private:
+	static constexpr bool simd_sum = std::is_same_v<M, Monoid::Sum<T>>;
+	static constexpr bool simd_min = std::is_same_v<M, Monoid::Min<T>>;
+	static constexpr bool simd_max = std::is_same_v<M, Monoid::Max<T>>;
+	static constexpr bool simd =
+		std::is_integral_v<T> && (sizeof(T) == 4 || sizeof(T) == 8) && B * sizeof(T) % 32 == 0
+		&& (simd_sum || simd_min || simd_max);
+
+	// 塊 blk の [from, to) を畳み込む
+	static T reduce(const T* const blk, const u32 from, const u32 to){
+#ifdef __AVX2__
+		if constexpr(simd) return reduce_avx2(blk, from, to);
+#endif
+		T res = e;
+		for(u32 i = from; i < to; ++i) res = op(res, blk[i]);
+		return res;
+	}
+
+#ifdef __AVX2__
+	static __m256i combine(const __m256i a, const __m256i b){
+		constexpr bool sign = std::is_signed_v<T>;
+		if constexpr(sizeof(T) == 4){
+			if constexpr(simd_sum) return _mm256_add_epi32(a, b);
+			else if constexpr(simd_min) return sign ? _mm256_min_epi32(a, b) : _mm256_min_epu32(a, b);
+			else return sign ? _mm256_max_epi32(a, b) : _mm256_max_epu32(a, b);
+		}
+		else{
+			if constexpr(simd_sum) return _mm256_add_epi64(a, b);
+			else{
+				// 64bit の min, max は比較して選ぶ 符号無しは最上位ビットを反転して比べる
+				const __m256i bias = _mm256_set1_epi64x(sign ? 0 : i64(1ULL << 63));
+				const __m256i gt = _mm256_cmpgt_epi64(_mm256_xor_si256(a, bias), _mm256_xor_si256(b, bias));
+				return simd_min ? _mm256_blendv_epi8(a, b, gt) : _mm256_blendv_epi8(b, a, gt);
+			}
+		}
+	}
+
+	static T reduce_avx2(const T* const blk, const u32 from, const u32 to){
+		constexpr u32 W = 32 / sizeof(T);
+		const __m256i id = sizeof(T) == 4 ? _mm256_set1_epi32(i32(e)) : _mm256_set1_epi64x(i64(e));
+		const __m256i lane = sizeof(T) == 4 ? _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7) : _mm256_setr_epi64x(0, 1, 2, 3);
+		__m256i acc = id;
+		for(u32 j = 0; j < B; j += W){
+			if(j >= to || j + W <= from) continue;
+			__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(blk + j));
+			if(j < from || j + W > to){
+				// 範囲外のレーンを単位元で置き換える
+				__m256i in;
+				if constexpr(sizeof(T) == 4){
+					const __m256i idx = _mm256_add_epi32(lane, _mm256_set1_epi32(j));
+					in = _mm256_and_si256(_mm256_cmpgt_epi32(idx, _mm256_set1_epi32(i32(from) - 1)), _mm256_cmpgt_epi32(_mm256_set1_epi32(to), idx));
+				}
+				else{
+					const __m256i idx = _mm256_add_epi64(lane, _mm256_set1_epi64x(j));
+					in = _mm256_and_si256(_mm256_cmpgt_epi64(idx, _mm256_set1_epi64x(i64(from) - 1)), _mm256_cmpgt_epi64(_mm256_set1_epi64x(to), idx));
+				}
+				v = _mm256_blendv_epi8(id, v, in);
+			}
+			acc = combine(acc, v);
+		}
+		// 128bit ずつ半分に畳んでいく
+		acc = combine(acc, _mm256_permute2x128_si256(acc, acc, 1));
+		acc = combine(acc, _mm256_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+		if constexpr(sizeof(T) == 4) acc = combine(acc, _mm256_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+		return T(sizeof(T) == 4 ? u32(_mm256_cvtsi256_si32(acc)) : u64(_mm256_extract_epi64(acc, 0)));
+	}
+#endif
+};
+
+#endif